@@ -0,0 +1,109 @@
+//
+// Copyright (C) 2016 Mirko Maischberger <mirko.maischberger@gmail.com>
+//
+// This file is part of WavingZ.
+//
+// WavingZ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// WavingZ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include "dsp.h"
+#include "wavingz.h"
+
+#include <complex>
+#include <memory>
+#include <vector>
+
+namespace wavingz
+{
+
+///
+/// Splits a wideband capture into several Z-Wave channels.
+///
+/// Each channel is moved to DC by its own nco and handed to its own
+/// demodulator, whose decimating FIR acts as the channel filter. Frames are
+/// reported with the index of the channel they were received on
+/// (frame_view_t::channel).
+///
+template <typename Demod = demod::demod_nrz>
+struct channelizer
+{
+    ///
+    /// @param sample_rate The capture sample rate
+    /// @param offsets Channel centre frequencies relative to the capture
+    ///        centre frequency (Hz), within +/- sample_rate / 2
+    /// @param sink Frame sink, each channel demodulator gets its own copy
+    /// @param decimation Decimation of each channel demodulator
+    ///
+    template <typename SinkArg>
+    channelizer(size_t sample_rate, const std::vector<double>& offsets,
+                const SinkArg& sink, size_t decimation = 1)
+    {
+        for (size_t ii(0); ii != offsets.size(); ++ii)
+        {
+            channels_m.emplace_back(new channel_t(sample_rate, offsets[ii], sink, decimation));
+            channels_m.back()->demod.channel = ii;
+        }
+    }
+
+    /// Feed a block of capture samples to every channel
+    template <typename T>
+    void process(const std::complex<T>* begin, const std::complex<T>* end)
+    {
+        for (auto& channel : channels_m)
+        {
+            if (channel->offset == 0.0)
+            {
+                channel->demod.process(begin, end);
+                continue;
+            }
+            for (const std::complex<T>* block = begin; block != end;)
+            {
+                const size_t n = std::min(size_t(end - block), mixed_m.size());
+                channel->mixer(block, mixed_m.data(), n);
+                channel->demod.process(mixed_m.data(), mixed_m.data() + n);
+                block += n;
+            }
+        }
+    }
+
+    size_t size() const { return channels_m.size(); }
+
+    /// The demodulator of a channel (e.g. to set its squelch)
+    Demod& demod(size_t channel) { return channels_m[channel]->demod; }
+
+  private:
+    struct channel_t
+    {
+        template <typename SinkArg>
+        channel_t(size_t sample_rate, double offset, const SinkArg& sink,
+                  size_t decimation)
+          : offset(offset)
+          , mixer(sample_rate, offset)
+          , demod(sample_rate, sink, decimation)
+        {
+        }
+
+        const double offset;
+        nco mixer;
+        Demod demod;
+    };
+
+    std::vector<std::unique_ptr<channel_t>> channels_m;
+    std::vector<std::complex<double>> mixed_m = std::vector<std::complex<double>>(4096);
+};
+
+} // namespace
@@ -0,0 +1,288 @@
+//
+// Copyright (C) 2016 Mirko Maischberger <mirko.maischberger@gmail.com>
+//
+// This file is part of WavingZ.
+//
+// WavingZ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// WavingZ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace wavingz
+{
+
+/// A value decoded from a report
+struct measurement_t
+{
+    const char* label; // e.g. "Temperature", nullptr when nothing was decoded
+    double value;
+    const char* unit;  // printed right after the value
+    const char* state; // binary reports: printed instead of the value
+};
+
+//
+// Command class reports are decoded through a registry: a table sorted on
+// (command class, command, type) whose entries name the value and point to
+// a decoder generated from a template for the layout of the report. Adding
+// a device type is adding an entry.
+//
+
+/// Matches any type byte
+constexpr uint16_t any_type = 0x100;
+
+/// Registry key of a report
+constexpr uint32_t
+report_key(uint8_t command_class, uint8_t command, uint16_t type)
+{
+    return uint32_t(command_class) << 17 | uint32_t(command) << 9 | type;
+}
+
+struct report_entry_t;
+
+/// Decodes a report, begin points to its command class, end to its checksum
+typedef measurement_t (*report_decoder_t)(const report_entry_t& entry,
+                                          const uint8_t* begin, const uint8_t* end);
+
+struct report_entry_t
+{
+    uint32_t key;           // report_key()
+    const char* label;
+    const char* units[8];   // by scale
+    const char* states[2];  // binary reports: zero and non zero value
+    report_decoder_t decode;
+};
+
+namespace report
+{
+
+/// Big-endian signed integer of 1, 2 or 4 bytes
+inline int32_t
+load_be(const uint8_t* p, size_t size)
+{
+    switch (size)
+    {
+    case 1: return int8_t(p[0]);
+    case 2: return int16_t(p[0] << 8 | p[1]);
+    default: return int32_t(uint32_t(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3]);
+    }
+}
+
+///
+/// Value with a precision/scale/size byte at Offset (Multilevel Sensor,
+/// Meter): bits 7-5 precision, 4-3 scale, 2-0 size of the value following
+/// it. ScaleBit2 is the byte holding the third scale bit in its MSB (Meter
+/// v3), 0 when there is none.
+///
+template <size_t Offset, size_t ScaleBit2 = 0>
+measurement_t
+scaled(const report_entry_t& entry, const uint8_t* begin, const uint8_t* end)
+{
+    measurement_t m = { nullptr, 0.0, "", nullptr };
+    if (size_t(end - begin) <= Offset) return m;
+    const uint8_t pss = begin[Offset];
+    const size_t size = pss & 0x07;
+    if ((size != 1 && size != 2 && size != 4) || size_t(end - begin) < Offset + 1 + size)
+    {
+        return m;
+    }
+    static const double scale_down[8] = { 1, 10, 100, 1000, 1e4, 1e5, 1e6, 1e7 };
+    size_t scale = (pss >> 3) & 0x03;
+    if (ScaleBit2 && (begin[ScaleBit2] & 0x80)) scale += 4;
+    m.label = entry.label;
+    m.value = load_be(begin + Offset + 1, size) / scale_down[pss >> 5];
+    m.unit = entry.units[scale] ? entry.units[scale] : "";
+    return m;
+}
+
+/// Level byte at Offset, 0xff means the state "ON" at 100 (Basic, Switch Multilevel)
+template <size_t Offset>
+measurement_t
+level(const report_entry_t& entry, const uint8_t* begin, const uint8_t* end)
+{
+    measurement_t m = { nullptr, 0.0, "", nullptr };
+    if (size_t(end - begin) <= Offset) return m;
+    m.label = entry.label;
+    m.value = begin[Offset];
+    m.unit = entry.units[0] ? entry.units[0] : "";
+    if (begin[Offset] == 0xff)
+    {
+        m.value = 100.0;
+        m.state = "ON";
+    }
+    return m;
+}
+
+/// Battery level byte at Offset, 0xff means the state "LOW"
+template <size_t Offset>
+measurement_t
+battery(const report_entry_t& entry, const uint8_t* begin, const uint8_t* end)
+{
+    measurement_t m = { nullptr, 0.0, "", nullptr };
+    if (size_t(end - begin) <= Offset) return m;
+    m.label = entry.label;
+    m.value = begin[Offset];
+    m.unit = entry.units[0] ? entry.units[0] : "";
+    if (begin[Offset] == 0xff) m.state = "LOW";
+    return m;
+}
+
+/// Byte at Offset, zero or non zero state (Binary Sensor, Switch Binary)
+template <size_t Offset>
+measurement_t
+binary(const report_entry_t& entry, const uint8_t* begin, const uint8_t* end)
+{
+    measurement_t m = { nullptr, 0.0, "", nullptr };
+    if (size_t(end - begin) <= Offset) return m;
+    m.label = entry.label;
+    m.value = begin[Offset] ? 1.0 : 0.0;
+    m.state = entry.states[begin[Offset] ? 1 : 0];
+    return m;
+}
+
+/// Notification v2+: the event at Offset, named for the well known ones
+template <size_t Offset>
+measurement_t
+event(const report_entry_t& entry, const uint8_t* begin, const uint8_t* end)
+{
+    static const struct
+    {
+        uint8_t type;
+        uint8_t event;
+        const char* name;
+    } names[] = {
+        { 0x01, 0x01, "SMOKE" },    { 0x01, 0x02, "SMOKE" },
+        { 0x04, 0x01, "OVERHEAT" }, { 0x04, 0x02, "OVERHEAT" },
+        { 0x05, 0x01, "LEAK" },     { 0x05, 0x02, "LEAK" },
+        { 0x06, 0x16, "OPEN" },     { 0x06, 0x17, "CLOSED" },
+        { 0x07, 0x03, "TAMPER" },   { 0x07, 0x07, "MOTION" },
+        { 0x07, 0x08, "MOTION" },   { 0x08, 0x02, "AC DISCONNECTED" },
+        { 0x08, 0x03, "AC RECONNECTED" },
+    };
+    measurement_t m = { nullptr, 0.0, "", nullptr };
+    if (size_t(end - begin) <= Offset) return m;
+    m.label = entry.label;
+    m.value = begin[Offset];
+    if (begin[Offset] == 0x00) m.state = "IDLE";
+    for (const auto& name : names)
+    {
+        if (name.type == begin[Offset - 1] && name.event == begin[Offset]) m.state = name.name;
+    }
+    return m;
+}
+
+/// Where a command class keeps the type byte of its reports
+inline uint16_t
+type_of(const uint8_t* begin, const uint8_t* end)
+{
+    const size_t size = end - begin;
+    switch (begin[0])
+    {
+    case 0x30: return size > 3 ? begin[3] : any_type;       // Binary Sensor v2
+    case 0x32: return size > 2 ? begin[2] & 0x1f : any_type; // Meter type
+    case 0x71: return size > 6 ? begin[6] : any_type;       // Notification type
+    default: return size > 2 ? begin[2] : any_type;
+    }
+}
+
+} // namespace
+
+///
+/// The registry, sorted by key.
+///
+/// @returns The first entry, *size is set to the number of entries
+///
+inline const report_entry_t*
+report_registry(size_t* size)
+{
+    static const report_entry_t entries[] = {
+        // Basic Report
+        { report_key(0x20, 0x03, any_type), "Basic", { "" }, { nullptr }, report::level<2> },
+        // Switch Binary Report
+        { report_key(0x25, 0x03, any_type), "Switch", { nullptr }, { "OFF", "ON" }, report::binary<2> },
+        // Switch Multilevel Report
+        { report_key(0x26, 0x03, any_type), "Level", { "%" }, { nullptr }, report::level<2> },
+        // Binary Sensor Report, v1 (no type) and unlisted types are generic
+        { report_key(0x30, 0x03, 0x02), "Smoke", { nullptr }, { "IDLE", "DETECTED" }, report::binary<2> },
+        { report_key(0x30, 0x03, 0x06), "Water", { nullptr }, { "DRY", "WET" }, report::binary<2> },
+        { report_key(0x30, 0x03, 0x08), "Tamper", { nullptr }, { "IDLE", "DETECTED" }, report::binary<2> },
+        { report_key(0x30, 0x03, 0x0a), "Door", { nullptr }, { "CLOSED", "OPEN" }, report::binary<2> },
+        { report_key(0x30, 0x03, 0x0c), "Motion", { nullptr }, { "IDLE", "DETECTED" }, report::binary<2> },
+        { report_key(0x30, 0x03, any_type), "Binary sensor", { nullptr }, { "IDLE", "DETECTED" }, report::binary<2> },
+        // Multilevel Sensor Report, by sensor type
+        { report_key(0x31, 0x05, 0x01), "Temperature", { "C", "F" }, { nullptr }, report::scaled<3> },
+        { report_key(0x31, 0x05, 0x02), "General purpose", { "%", "" }, { nullptr }, report::scaled<3> },
+        { report_key(0x31, 0x05, 0x03), "Luminance", { "%", "Lux" }, { nullptr }, report::scaled<3> },
+        { report_key(0x31, 0x05, 0x04), "Power", { "W", "Btu/h" }, { nullptr }, report::scaled<3> },
+        { report_key(0x31, 0x05, 0x05), "Humidity", { "%", "g/m3" }, { nullptr }, report::scaled<3> },
+        { report_key(0x31, 0x05, 0x06), "Velocity", { "m/s", "mph" }, { nullptr }, report::scaled<3> },
+        { report_key(0x31, 0x05, 0x08), "Atmospheric pressure", { "kPa", "inHg" }, { nullptr }, report::scaled<3> },
+        { report_key(0x31, 0x05, 0x09), "Barometric pressure", { "kPa", "inHg" }, { nullptr }, report::scaled<3> },
+        { report_key(0x31, 0x05, 0x0b), "Dew point", { "C", "F" }, { nullptr }, report::scaled<3> },
+        { report_key(0x31, 0x05, 0x0f), "Voltage", { "V", "mV" }, { nullptr }, report::scaled<3> },
+        { report_key(0x31, 0x05, 0x10), "Current", { "A", "mA" }, { nullptr }, report::scaled<3> },
+        { report_key(0x31, 0x05, 0x11), "CO2", { "ppm" }, { nullptr }, report::scaled<3> },
+        { report_key(0x31, 0x05, 0x17), "Water temperature", { "C", "F" }, { nullptr }, report::scaled<3> },
+        { report_key(0x31, 0x05, 0x1b), "Ultraviolet", { "UV" }, { nullptr }, report::scaled<3> },
+        // Meter Report, by meter type
+        { report_key(0x32, 0x02, 0x01), "Electric meter", { "kWh", "kVAh", "W", "pulses", "V", "A", "PF" },
+          { nullptr }, report::scaled<3, 2> },
+        { report_key(0x32, 0x02, 0x02), "Gas meter", { "m3", "ft3", "", "pulses" }, { nullptr }, report::scaled<3, 2> },
+        { report_key(0x32, 0x02, 0x03), "Water meter", { "m3", "ft3", "US gal", "pulses" }, { nullptr },
+          report::scaled<3, 2> },
+        // Notification Report v2+, by notification type
+        { report_key(0x71, 0x05, 0x01), "Smoke alarm", { "" }, { nullptr }, report::event<7> },
+        { report_key(0x71, 0x05, 0x04), "Heat alarm", { "" }, { nullptr }, report::event<7> },
+        { report_key(0x71, 0x05, 0x05), "Water alarm", { "" }, { nullptr }, report::event<7> },
+        { report_key(0x71, 0x05, 0x06), "Access control", { "" }, { nullptr }, report::event<7> },
+        { report_key(0x71, 0x05, 0x07), "Home security", { "" }, { nullptr }, report::event<7> },
+        { report_key(0x71, 0x05, 0x08), "Power management", { "" }, { nullptr }, report::event<7> },
+        { report_key(0x71, 0x05, 0x09), "System", { "" }, { nullptr }, report::event<7> },
+        // Battery Report
+        { report_key(0x80, 0x03, any_type), "Battery", { "%" }, { nullptr }, report::battery<2> },
+    };
+    *size = sizeof(entries) / sizeof(entries[0]);
+    return entries;
+}
+
+///
+/// Decode a report through the registry: one lookup on (command class,
+/// command, type), then the entry decoder loads the value.
+///
+/// @param begin The command class byte
+/// @param end One past the last byte before the checksum
+///
+inline measurement_t
+decode_report(const uint8_t* begin, const uint8_t* end)
+{
+    measurement_t none = { nullptr, 0.0, "", nullptr };
+    if (end - begin < 2) return none;
+
+    size_t size;
+    const report_entry_t* entries = report_registry(&size);
+    auto find = [&](uint32_t key) -> const report_entry_t* {
+        const report_entry_t* entry = std::lower_bound(
+            entries, entries + size, key,
+            [](const report_entry_t& e, uint32_t k) { return e.key < k; });
+        return entry != entries + size && entry->key == key ? entry : nullptr;
+    };
+    const report_entry_t* entry = find(report_key(begin[0], begin[1], report::type_of(begin, end)));
+    if (!entry) entry = find(report_key(begin[0], begin[1], any_type));
+    return entry ? entry->decode(*entry, begin, end) : none;
+}
+
+} // namespace
@@ -23,8 +23,8 @@
 
 #pragma once
 
-#include <boost/circular_buffer.hpp>
 #include <algorithm>
+#include <cassert>
 #include <functional>
 #include <iostream>
 #include <numeric>
@@ -205,6 +205,341 @@ butter_hp(double sample_rate, double cutoff_freq)
                            acof_bwhp<ORDER>(2.0 * cutoff_freq / sample_rate));
 }
 
+///
+/// Windowed sinc (Hamming) low-pass FIR design, unit gain at DC
+///
+/// @param taps Number of coefficients
+/// @param sample_rate The desired sample rate (=2*Nyquist)
+/// @param cutoff_freq The -6dB cutoff frequency
+///
+/// @returns The filter coefficients
+///
+inline std::vector<double>
+fir_lp(size_t taps, double sample_rate, double cutoff_freq)
+{
+    std::vector<double> h(taps);
+    const double fc = cutoff_freq / sample_rate;
+    const double center = (taps - 1) / 2.0;
+    double sum = 0.0;
+    for (size_t ii(0); ii != taps; ++ii)
+    {
+        double t = ii - center;
+        double sinc = t == 0.0 ? 2.0 * fc : sin(2.0 * M_PI * fc * t) / (M_PI * t);
+        double window = taps > 1 ? 0.54 - 0.46 * cos(2.0 * M_PI * ii / (taps - 1)) : 1.0;
+        h[ii] = sinc * window;
+        sum += h[ii];
+    }
+    for (auto& c : h) c /= sum;
+    return h;
+}
+
+///
+/// Decimating FIR filter
+///
+/// Keeps one output every `decimation` inputs and only evaluates the filter
+/// for the outputs it keeps, the cost of a polyphase decimator: taps /
+/// decimation multiply-adds per input sample.
+///
+template <typename T>
+struct fir_decimator
+{
+    ///
+    /// @param decimation Decimation factor
+    /// @param taps Filter coefficients (e.g. from fir_lp)
+    ///
+    fir_decimator(size_t decimation, const std::vector<double>& taps)
+      : decimation_m(decimation)
+      , taps_m(taps.rbegin(), taps.rend())
+      , history_m(2 * taps.size(), T(0))
+    {
+    }
+
+    /// Number of inputs still needed (including the next one) for an output
+    size_t remaining() const { return decimation_m - phase_m; }
+
+    size_t decimation() const { return decimation_m; }
+
+    /// Group delay of a linear phase filter, in input samples
+    double group_delay() const { return (taps_m.size() - 1) / 2.0; }
+
+    ///
+    /// Feed one sample.
+    ///
+    /// @returns true when out holds a new output
+    ///
+    bool operator()(const T& in, T& out)
+    {
+        const size_t size = taps_m.size();
+        history_m[pos_m] = history_m[pos_m + size] = in;
+        pos_m = pos_m + 1 == size ? 0 : pos_m + 1;
+        if (++phase_m != decimation_m) return false;
+        phase_m = 0;
+        // history_m[pos_m, pos_m + size) holds the inputs, oldest first
+        const T* x = &history_m[pos_m];
+        T acc(0);
+        for (size_t kk(0); kk != size; ++kk)
+        {
+            acc += taps_m[kk] * x[kk];
+        }
+        out = acc;
+        return true;
+    }
+
+    ///
+    /// Filter and decimate a block.
+    ///
+    /// @param in The input samples
+    /// @param n Number of input samples
+    /// @param out The decimated output (may be the same as in)
+    ///
+    /// @returns Number of outputs written
+    ///
+    size_t process(const T* in, size_t n, T* out)
+    {
+        size_t m = 0;
+        for (size_t ii(0); ii != n; ++ii)
+        {
+            if ((*this)(in[ii], out[m])) ++m;
+        }
+        return m;
+    }
+
+  private:
+    const size_t decimation_m;
+    std::vector<double> taps_m; // reversed
+    std::vector<T> history_m;   // doubled, so the window is always contiguous
+    size_t pos_m = 0;
+    size_t phase_m = 0;
+};
+
+///
+/// Numerically controlled oscillator mixer
+///
+/// Shifts the signal down by `freq`, so a channel centred at `freq` ends up
+/// at DC. The phase is kept as a unit phasor, renormalized every block.
+///
+struct nco
+{
+    ///
+    /// @param sample_rate The desired sample rate (=2*Nyquist)
+    /// @param freq The frequency moved to DC
+    ///
+    nco(double sample_rate, double freq)
+      : step_m(std::polar(1.0, -2.0 * M_PI * freq / sample_rate))
+    {
+    }
+
+    ///
+    /// Mix a block.
+    ///
+    /// @param in The input samples
+    /// @param out The shifted samples
+    /// @param n Number of samples
+    ///
+    template <typename T>
+    void operator()(const std::complex<T>* in, std::complex<double>* out, size_t n)
+    {
+        std::complex<double> phase = phase_m;
+        for (size_t ii(0); ii != n; ++ii)
+        {
+            out[ii] = std::complex<double>(in[ii]) * phase;
+            phase *= step_m;
+        }
+        phase_m = phase / std::abs(phase);
+    }
+
+  private:
+    const std::complex<double> step_m;
+    std::complex<double> phase_m = 1.0;
+};
+
+///
+/// Block power detector with an adaptive noise floor
+///
+/// The noise floor follows the power of the blocks that stay below the
+/// threshold; a squelch kept open for a long time (much longer than any
+/// frame) lets the floor creep up as well, so a change of gain or of
+/// background noise cannot keep it open forever.
+///
+struct energy_squelch
+{
+    ///
+    /// @param threshold_db Power above the noise floor that opens the squelch
+    /// @param min_power Mean power (full scale = 1) that never opens it
+    ///
+    explicit energy_squelch(double threshold_db = 6.0, double min_power = 1e-6)
+      : ratio_m(std::pow(10.0, threshold_db / 10.0))
+      , min_power_m(min_power)
+    {
+    }
+
+    ///
+    /// Measure a block.
+    ///
+    /// @returns true when the block power is above the threshold
+    ///
+    template <typename T>
+    bool operator()(const std::complex<T>* in, size_t n)
+    {
+        double power = 0.0;
+        for (size_t ii(0); ii != n; ++ii)
+        {
+            power += double(in[ii].real()) * in[ii].real() +
+                     double(in[ii].imag()) * in[ii].imag();
+        }
+        power /= n;
+        if (floor_m < 0.0) floor_m = power;
+
+        bool open = power > std::max(floor_m * ratio_m, min_power_m);
+        if (!open)
+        {
+            floor_m += 0.05 * (power - floor_m);
+            open_blocks_m = 0;
+        }
+        else if (++open_blocks_m > 1000)
+        {
+            floor_m += 0.001 * (power - floor_m);
+        }
+        return open;
+    }
+
+    /// Current noise floor estimate (mean power)
+    double noise_floor() const { return floor_m; }
+
+  private:
+    double ratio_m;
+    double min_power_m;
+    double floor_m = -1.0;
+    size_t open_blocks_m = 0;
+};
+
+///
+/// Normalized (Pearson) correlation of a signal with a binary symbol pattern
+///
+/// The pattern should hold as many '1' as '0' symbols, the correlation is
+/// then insensitive to a DC offset (e.g. the carrier frequency offset after
+/// an FM discriminator). The window is kept as one running sum per symbol,
+/// so a sample costs O(pattern symbols) whatever the samples per symbol.
+///
+struct symbol_correlator
+{
+    ///
+    /// @param pattern The symbols, oldest first ('1' correlates with > 0)
+    /// @param samples_per_symbol Samples per symbol of the signal
+    ///
+    symbol_correlator(const std::vector<bool>& pattern, double samples_per_symbol)
+    {
+        for (size_t kk(0); kk <= pattern.size(); ++kk)
+        {
+            bounds_m.push_back(size_t(std::lround(kk * samples_per_symbol)));
+        }
+        for (bool symbol : pattern)
+        {
+            sign_m.push_back(symbol ? 1.0 : -1.0);
+        }
+        // every sample is stored twice, so the window is always contiguous
+        window_m.assign(2 * bounds_m.back(), 0.0);
+        sums_m.assign(pattern.size(), 0.0);
+    }
+
+    ///
+    /// Add a sample.
+    ///
+    /// @returns true when the correlation of the window ending with this
+    ///          sample is above threshold (at most 1)
+    ///
+    bool operator()(double x, double threshold)
+    {
+        const size_t n = size();
+        const double* w = &window_m[oldest_m];
+        // each symbol gains the oldest sample of the next one and loses
+        // its own oldest sample
+        const size_t last = sums_m.size() - 1;
+        for (size_t kk(0); kk != last; ++kk)
+        {
+            sums_m[kk] += w[bounds_m[kk + 1]] - w[bounds_m[kk]];
+        }
+        sums_m[last] += x - w[bounds_m[last]];
+        sum_m += x - w[0];
+        sum_sq_m += x * x - w[0] * w[0];
+        window_m[oldest_m] = window_m[oldest_m + n] = x;
+        oldest_m = oldest_m + 1 == n ? 0 : oldest_m + 1;
+
+        if (++count_m % n == 0)
+        {
+            resync();
+        }
+        if (count_m < n)
+        {
+            return false;
+        }
+        double c = 0.0;
+        for (size_t kk(0); kk != sums_m.size(); ++kk)
+        {
+            c += sign_m[kk] * sums_m[kk];
+        }
+        // a flat window (e.g. digital silence) never correlates, whatever
+        // the rounding errors of the running sums
+        double energy = sum_sq_m - sum_m * sum_m / n;
+        return c > 0.0 && energy > 1e-12 * n && c * c > threshold * threshold * energy * n;
+    }
+
+    /// Correlation of the current window, in [-1, 1]
+    double correlation() const
+    {
+        const size_t n = size();
+        double c = 0.0;
+        for (size_t kk(0); kk != sums_m.size(); ++kk)
+        {
+            c += sign_m[kk] * sums_m[kk];
+        }
+        double energy = sum_sq_m - sum_m * sum_m / n;
+        return energy > 0.0 ? c / std::sqrt(energy * n) : 0.0;
+    }
+
+    /// Mean of the window
+    double mean() const { return sum_m / size(); }
+
+    /// Standard deviation of the window
+    double deviation() const
+    {
+        return std::sqrt(std::max(0.0, sum_sq_m / size() - mean() * mean()));
+    }
+
+    /// Window length in samples
+    size_t size() const { return window_m.size() / 2; }
+
+  private:
+    /// Recompute the running sums, so rounding errors cannot pile up
+    void resync()
+    {
+        const double* w = &window_m[oldest_m];
+        sum_m = sum_sq_m = 0.0;
+        for (size_t ii(0); ii != size(); ++ii)
+        {
+            sum_m += w[ii];
+            sum_sq_m += w[ii] * w[ii];
+        }
+        for (size_t kk(0); kk != sums_m.size(); ++kk)
+        {
+            sums_m[kk] = 0.0;
+            for (size_t ii(bounds_m[kk]); ii != bounds_m[kk + 1]; ++ii)
+            {
+                sums_m[kk] += w[ii];
+            }
+        }
+    }
+
+    std::vector<size_t> bounds_m; // window index of the first sample of each symbol
+    std::vector<double> sign_m;
+    std::vector<double> window_m; // from oldest_m, the window oldest first
+    std::vector<double> sums_m;   // sum of the samples of each symbol
+    size_t oldest_m = 0;
+    size_t count_m = 0;
+    double sum_m = 0.0;
+    double sum_sq_m = 0.0;
+};
+
 /// Simple arctan demodulator
 struct atan_fm_demodulator
 {
@@ -220,12 +555,113 @@ struct atan_fm_demodulator
         s1 = s;
         return d;
     }
+
+    /// Demodulate a block given as separate I and Q arrays
+    void operator()(const double* i, const double* q, double* out, size_t n)
+    {
+        for (size_t ii(0); ii != n; ++ii)
+        {
+            out[ii] = (*this)(std::complex<double>(i[ii], q[ii]));
+        }
+    }
     std::complex<double> s1;
 };
 
+///
+/// Arctan demodulator using a polynomial atan2 approximation
+///
+/// Max error is about 2e-6 rad. The octant corrections are selects computed
+/// by arithmetic instead of branches, so the block version is vectorized by
+/// the compiler (check with -fopt-info-vec).
+///
+struct fast_atan_fm_demodulator
+{
+    /// atan2(y, x) approximation
+    static double atan2(double y, double x)
+    {
+        double ax = std::abs(x);
+        double ay = std::abs(y);
+        double mx = ax > ay ? ax : ay;
+        double mn = ax > ay ? ay : ax;
+        double a = mn / (mx + double(mx == 0.0));
+        double s = a * a;
+        double r = a * (0.99997726 + s * (-0.33262347 + s * (0.19354346 +
+                   s * (-0.11643287 + s * (0.05265332 + s * -0.01172120)))));
+        r += double(ay > ax) * (M_PI / 2 - 2.0 * r);
+        r += double(x < 0.0) * (M_PI - 2.0 * r);
+        return std::copysign(r, y);
+    }
+
+    /// Q&I
+    double operator()(const std::complex<double>& s)
+    {
+        double re = s1.real() * s.real() + s1.imag() * s.imag();
+        double im = s1.real() * s.imag() - s1.imag() * s.real();
+        s1 = s;
+        return atan2(im, re);
+    }
+
+    /// Demodulate a block given as separate I and Q arrays
+    void operator()(const double* i, const double* q, double* out, size_t n)
+    {
+        if (n == 0) return;
+        out[0] = (*this)(std::complex<double>(i[0], q[0]));
+        for (size_t ii(1); ii != n; ++ii)
+        {
+            double re = i[ii - 1] * i[ii] + q[ii - 1] * q[ii];
+            double im = i[ii - 1] * q[ii] - q[ii - 1] * i[ii];
+            out[ii] = atan2(im, re);
+        }
+        s1 = std::complex<double>(i[n - 1], q[n - 1]);
+    }
+    std::complex<double> s1 = 0.0;
+};
+
+///
+/// Quadricorrelator: Im(conj(s1) * s) / |s|^2
+///
+/// Proportional to sin() of the phase step rather than to the phase step
+/// itself, which is close enough while the step stays well below pi/2,
+/// at the cost of a few multiplications and one division. Branch free, the
+/// block version is vectorized by the compiler.
+///
+struct quadricorrelator_fm_demodulator
+{
+    static double discriminate(double i1, double q1, double i, double q)
+    {
+        double power = i * i + q * q;
+        return (i1 * q - q1 * i) / (power + double(power == 0.0));
+    }
+
+    /// Q&I
+    double operator()(const std::complex<double>& s)
+    {
+        double d = discriminate(s1.real(), s1.imag(), s.real(), s.imag());
+        s1 = s;
+        return d;
+    }
+
+    /// Demodulate a block given as separate I and Q arrays
+    void operator()(const double* i, const double* q, double* out, size_t n)
+    {
+        if (n == 0) return;
+        out[0] = (*this)(std::complex<double>(i[0], q[0]));
+        for (size_t ii(1); ii != n; ++ii)
+        {
+            out[ii] = discriminate(i[ii - 1], q[ii - 1], i[ii], q[ii]);
+        }
+        s1 = std::complex<double>(i[n - 1], q[n - 1]);
+    }
+    std::complex<double> s1 = 0.0;
+};
+
 ///
 /// Generic IIR filter simulator or specified ORDER
 ///
+/// Direct form II transposed: the filter state is ORDER values kept in a
+/// fixed size array, and every loop has a compile time trip count so the
+/// compiler can fully unroll it and keep the state in registers.
+///
 template <int ORDER>
 struct iir_filter
 {
@@ -238,15 +674,14 @@ struct iir_filter
     ///
     explicit iir_filter(double gain, const std::array<double, ORDER + 1>& b,
                         const std::array<double, ORDER + 1>& a)
-      : gain_m(gain)
-      , b_m(b)
-      , a_m(a)
-      , xv_m(ORDER + 1, 0)
-      , yv_m(ORDER + 1, 0)
+      : a_m(a)
     {
         assert(a[0] == 1.0);
         for (size_t ii(0); ii != (ORDER + 1) / 2; ++ii)
             assert(b[ii] == b[b.size() - ii - 1]);
+        for (size_t ii(0); ii != ORDER + 1; ++ii)
+            b_m[ii] = gain * b[ii];
+        z_m.fill(0.0);
     }
 
     ///
@@ -267,18 +702,71 @@ struct iir_filter
     ///
     double operator()(double in)
     {
-        xv_m.push_front(in);
-        double yvn =
-            gain_m * std::inner_product(xv_m.begin(), xv_m.end(), b_m.begin(), 0.0) -
-            std::inner_product(yv_m.begin(), yv_m.end(), a_m.begin() + 1, 0.0);
-        yv_m.push_front(yvn);
-        return yvn;
+        return step(in, z_m);
+    }
+
+    ///
+    /// Filter a block of samples.
+    ///
+    /// @param in The input samples
+    /// @param out The filtered output (may be the same as in)
+    /// @param n Number of samples
+    ///
+    void process(const double* in, double* out, size_t n)
+    {
+        std::array<double, ORDER> z = z_m;
+        for (size_t ii(0); ii != n; ++ii)
+        {
+            out[ii] = step(in[ii], z);
+        }
+        z_m = z;
+    }
+
+    ///
+    /// Whether the filter has rung down.
+    ///
+    /// @param level Largest state magnitude considered negligible
+    /// @returns true when the output for a zero input stays negligible
+    ///
+    bool settled(double level) const
+    {
+        for (double z : z_m)
+        {
+            if (std::abs(z) >= level) return false;
+        }
+        return true;
+    }
+
+    /// Clear the filter memory
+    void reset() { z_m.fill(0.0); }
+
+    /// Group delay at DC, in samples
+    double group_delay() const
+    {
+        double b = 0.0, kb = 0.0, a = 0.0, ka = 0.0;
+        for (size_t k(0); k != ORDER + 1; ++k)
+        {
+            b += b_m[k];
+            kb += k * b_m[k];
+            a += a_m[k];
+            ka += k * a_m[k];
+        }
+        return kb / b - ka / a;
     }
 
   private:
-    double gain_m;
-    std::array<double, ORDER + 1> b_m;
+    double step(double in, std::array<double, ORDER>& z) const
+    {
+        double out = b_m[0] * in + z[0];
+        for (int k(1); k != ORDER; ++k)
+        {
+            z[k - 1] = b_m[k] * in - a_m[k] * out + z[k];
+        }
+        z[ORDER - 1] = b_m[ORDER] * in - a_m[ORDER] * out;
+        return out;
+    }
+
+    std::array<double, ORDER + 1> b_m; // gain included
     std::array<double, ORDER + 1> a_m;
-    boost::circular_buffer<double> xv_m;
-    boost::circular_buffer<double> yv_m;
+    std::array<double, ORDER> z_m;
 };
@@ -0,0 +1,269 @@
+//
+// Copyright (C) 2016 Mirko Maischberger <mirko.maischberger@gmail.com>
+//
+// This file is part of WavingZ.
+//
+// WavingZ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// WavingZ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include "wavingz.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+namespace wavingz
+{
+
+//
+// Frame formatters: sinks taking a decoded_frame_t, so a frame is decoded
+// once and only the enabled formatters do any work. Each one writes whole
+// lines, built in a local buffer instead of going through iostream
+// manipulators.
+//
+
+/// Write bytes as "xx xx xx " (no line end)
+inline void
+write_hex(std::ostream& out, const uint8_t* begin, const uint8_t* end)
+{
+    static const char digits[] = "0123456789abcdef";
+    char line[3 * 64];
+    while (begin != end)
+    {
+        size_t n = std::min<size_t>(end - begin, sizeof(line) / 3);
+        for (size_t ii(0); ii != n; ++ii)
+        {
+            line[3 * ii] = digits[begin[ii] >> 4];
+            line[3 * ii + 1] = digits[begin[ii] & 0xf];
+            line[3 * ii + 2] = ' ';
+        }
+        out.write(line, 3 * n);
+        begin += n;
+    }
+}
+
+/// The bytes of each frame in hex, one line per frame
+struct hex_formatter
+{
+    explicit hex_formatter(std::ostream& out)
+      : out_m(out)
+    {
+    }
+
+    void operator()(const decoded_frame_t& frame)
+    {
+        write_hex(out_m, frame.begin, frame.end);
+        out_m << '\n';
+    }
+
+  private:
+    std::ostream& out_m;
+};
+
+///
+/// The data.txt text log: the local time of each frame, '@' and its bytes
+/// in hex, one line per frame.
+///
+/// Times are nanoseconds since the Unix epoch, printed to the second as
+/// "YYYY-MM-DD.HH:MM:SS". localtime() is only called when the hour changes,
+/// minutes and seconds are integer arithmetic.
+///
+struct log_formatter
+{
+    explicit log_formatter(std::ostream& out)
+      : out_m(out)
+    {
+    }
+
+    /// A frame received now
+    void operator()(const decoded_frame_t& frame)
+    {
+        (*this)(frame, uint64_t(time(nullptr)) * 1000000000);
+    }
+
+    /// A frame received at time_ns
+    void operator()(const decoded_frame_t& frame, uint64_t time_ns)
+    {
+        const time_t when = time_t(time_ns / 1000000000);
+        if (when < hour_start_m || when >= hour_start_m + 3600)
+        {
+            struct tm tstruct;
+            localtime_r(&when, &tstruct);
+            prefix_size_m = strftime(stamp_m, sizeof(stamp_m) - 6, "%Y-%m-%d.%H:", &tstruct);
+            hour_start_m = when - 60 * tstruct.tm_min - tstruct.tm_sec;
+        }
+        const unsigned minutes = unsigned(when - hour_start_m) / 60;
+        const unsigned seconds = unsigned(when - hour_start_m) % 60;
+        char* p = stamp_m + prefix_size_m;
+        p[0] = char('0' + minutes / 10);
+        p[1] = char('0' + minutes % 10);
+        p[2] = ':';
+        p[3] = char('0' + seconds / 10);
+        p[4] = char('0' + seconds % 10);
+        p[5] = '@';
+        out_m.write(stamp_m, prefix_size_m + 6);
+        write_hex(out_m, frame.begin, frame.end);
+        out_m << '\n';
+    }
+
+  private:
+    std::ostream& out_m;
+    time_t hour_start_m = std::numeric_limits<time_t>::min();
+    char stamp_m[80];
+    size_t prefix_size_m = 0; // "YYYY-MM-DD.HH:"
+};
+
+///
+/// Parse a time given on the command line: seconds since the Unix epoch
+/// ("1458480600.5") or a local time ("2016-03-20 13:30:00", the date and
+/// the time may also be separated by '.' as in data.txt, or by 'T'), both
+/// with optional fractional seconds.
+///
+/// @returns Nanoseconds since the Unix epoch
+/// @throws std::runtime_error when the time cannot be parsed
+///
+inline uint64_t
+parse_time_ns(const std::string& text)
+{
+    auto error = [&] { return std::runtime_error("bad time '" + text + "'"); };
+    // ".fff" at p, up to nanoseconds
+    auto fraction_ns = [&](const char* p) {
+        uint64_t ns = 0;
+        if (*p == '\0') return ns;
+        if (*p++ != '.' || !isdigit(static_cast<unsigned char>(*p))) throw error();
+        uint64_t scale = 100000000;
+        for (; isdigit(static_cast<unsigned char>(*p)); ++p, scale /= 10)
+        {
+            ns += (*p - '0') * scale;
+        }
+        if (*p != '\0') throw error();
+        return ns;
+    };
+
+    const char* p = text.c_str();
+    if (isdigit(static_cast<unsigned char>(*p)) &&
+        text.find_first_not_of("0123456789.") == std::string::npos)
+    {
+        uint64_t seconds = 0;
+        for (; isdigit(static_cast<unsigned char>(*p)); ++p)
+        {
+            seconds = 10 * seconds + (*p - '0');
+        }
+        return seconds * 1000000000 + fraction_ns(p);
+    }
+    for (const char* format : { "%Y-%m-%d %H:%M:%S", "%Y-%m-%d.%H:%M:%S", "%Y-%m-%dT%H:%M:%S" })
+    {
+        struct tm tstruct;
+        std::memset(&tstruct, 0, sizeof(tstruct));
+        const char* rest = strptime(text.c_str(), format, &tstruct);
+        if (!rest) continue;
+        tstruct.tm_isdst = -1;
+        const time_t seconds = mktime(&tstruct);
+        if (seconds < 0) throw error();
+        return uint64_t(seconds) * 1000000000 + fraction_ns(rest);
+    }
+    throw error();
+}
+
+///
+/// Human readable header, payload and measurement of each frame.
+///
+/// "[x]" marks a valid checksum, "[ ]" a bad one; frames shorter than
+/// their header or announced length only get the "[ ]".
+///
+struct summary_formatter
+{
+    explicit summary_formatter(std::ostream& out)
+      : out_m(out)
+    {
+    }
+
+    void operator()(const decoded_frame_t& frame)
+    {
+        print(frame);
+        out_m << '\n';
+    }
+
+    /// The summary without the line ending the frame (zwave_print)
+    void print(const decoded_frame_t& frame)
+    {
+        if (!frame.complete)
+        {
+            out_m << "[ ] ";
+            return;
+        }
+        const packet_t& p = frame.header;
+        char line[256];
+        int n = snprintf(line, sizeof(line),
+                         "%s HomeId: %x, SourceNodeId: %x, FC0: %x, FC1: %x, "
+                         "FC[speed=%u low_power=%u ack_request=%u header_type=%u "
+                         "beaming_info=%u seq=%u], Length: %u, DestNodeId: %u, "
+                         "CommandClass: %x, Payload: ",
+                         frame.checksum_ok ? "[x]" : "[ ]", frame.home_id(),
+                         p.source_node_id, p.fc0, p.fc1,
+                         unsigned(p.frame_control_0.speed),
+                         unsigned(p.frame_control_0.low_power),
+                         unsigned(p.frame_control_0.ack_request),
+                         unsigned(p.frame_control_0.header_type),
+                         unsigned(p.frame_control_1.beaming_info),
+                         unsigned(p.frame_control_1.sequence_number),
+                         unsigned(p.length), unsigned(p.dest_node_id),
+                         unsigned(p.command_class));
+        out_m.write(line, n);
+        write_hex(out_m, frame.payload_begin, frame.payload_end);
+        out_m << '\n';
+
+        const measurement_t& m = frame.measurement;
+        if (m.label)
+        {
+            n = m.state ? snprintf(line, sizeof(line), "%s %s\n", m.label, m.state)
+                        : snprintf(line, sizeof(line), "%s: %g%s\n", m.label, m.value, m.unit);
+            out_m.write(line, n);
+        }
+    }
+
+  private:
+    std::ostream& out_m;
+};
+
+///
+/// Debug print a packet: the log line to fout, the bytes and the summary to
+/// out, which is left for the caller to end.
+///
+template <typename It>
+inline std::ostream&
+zwave_print(std::ostream& fout, std::ostream& out, It data_begin, It data_end)
+{
+    const uint8_t* begin = data_begin == data_end ? nullptr : &*data_begin;
+    const decoded_frame_t frame = decode_frame(begin, begin + std::distance(data_begin, data_end));
+    log_formatter log_line(fout);
+    hex_formatter hex_line(out);
+    summary_formatter summary(out);
+    log_line(frame);
+    hex_line(frame);
+    summary.print(frame);
+    fout.flush();
+    out.flush();
+    return out;
+}
+
+} // namespace
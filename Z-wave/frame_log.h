@@ -0,0 +1,297 @@
+//
+// Copyright (C) 2016 Mirko Maischberger <mirko.maischberger@gmail.com>
+//
+// This file is part of WavingZ.
+//
+// WavingZ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// WavingZ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include "iq.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace wavingz
+{
+
+//
+// Binary frame log: an 8 bytes magic followed by one record per frame, a
+// fixed frame_record_t header and the frame bytes, padded to 8 bytes so
+// every header is aligned in a mapping. Integers are in host byte order.
+// The file is only ever appended to, a reader stops at a torn last record.
+//
+
+/// First bytes of a frame log (format version in the last one)
+inline const char*
+frame_log_magic()
+{
+    return "WZFLOG\0\1";
+}
+
+const size_t frame_log_magic_size = 8;
+
+/// Header of a frame log record, followed by length frame bytes
+struct frame_record_t
+{
+    uint64_t time_ns;   // reception time, nanoseconds since the Unix epoch
+    uint16_t channel;   // channelizer channel
+    int16_t power_cdb;  // frame power in 1/100 dBFS, no_power when unknown
+    uint16_t length;    // frame bytes following the header
+    uint16_t reserved;  // 0
+
+    static const int16_t no_power = std::numeric_limits<int16_t>::min();
+
+    /// Size of the whole record, padding included
+    static size_t record_size(size_t length) { return (sizeof(frame_record_t) + length + 7) & ~size_t(7); }
+};
+
+static_assert(sizeof(frame_record_t) == 16, "frame_record_t is part of the file format");
+
+/// A frame read from a log, pointing into the mapping
+struct frame_log_entry_t
+{
+    uint64_t time_ns;
+    size_t channel;
+    double power_db; // NaN when unknown
+    const uint8_t* begin;
+    const uint8_t* end;
+};
+
+///
+/// Memory mapped frame log.
+///
+/// Iterating is a walk over the mapping, hopping from header to header, so
+/// scanning a log runs at about memory (or disk read-ahead) bandwidth.
+///
+struct frame_log_reader
+{
+    /// @throws std::runtime_error when the file cannot be mapped or is not a frame log
+    explicit frame_log_reader(const std::string& path)
+      : file_m(path)
+    {
+        if (file_m.size() < frame_log_magic_size ||
+            std::memcmp(file_m.data(), frame_log_magic(), frame_log_magic_size) != 0)
+        {
+            throw std::runtime_error(path + ": not a frame log");
+        }
+    }
+
+    struct iterator
+    {
+        typedef std::forward_iterator_tag iterator_category;
+        typedef frame_log_entry_t value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const frame_log_entry_t* pointer;
+        typedef frame_log_entry_t reference;
+
+        iterator(const uint8_t* p, const uint8_t* end)
+          : p_m(p)
+          , end_m(end)
+        {
+            settle();
+        }
+
+        frame_log_entry_t operator*() const
+        {
+            frame_record_t record;
+            std::memcpy(&record, p_m, sizeof(record));
+            const uint8_t* begin = p_m + sizeof(record);
+            frame_log_entry_t entry = { record.time_ns, record.channel,
+                                        record.power_cdb == frame_record_t::no_power
+                                          ? std::nan("")
+                                          : record.power_cdb / 100.0,
+                                        begin, begin + record.length };
+            return entry;
+        }
+
+        iterator& operator++()
+        {
+            p_m = record_end();
+            settle();
+            return *this;
+        }
+
+        bool operator==(const iterator& other) const { return p_m == other.p_m; }
+        bool operator!=(const iterator& other) const { return p_m != other.p_m; }
+
+        /// First byte of the record
+        const uint8_t* position() const { return p_m; }
+
+        /// One past the last byte of the record, padding included
+        const uint8_t* record_end() const { return p_m + frame_record_t::record_size(length()); }
+
+      private:
+        uint16_t length() const
+        {
+            uint16_t length;
+            std::memcpy(&length, p_m + offsetof(frame_record_t, length), sizeof(length));
+            return length;
+        }
+
+        // a torn record (a write cut short) ends the log
+        void settle()
+        {
+            if (size_t(end_m - p_m) < sizeof(frame_record_t) ||
+                size_t(end_m - p_m) < frame_record_t::record_size(length()))
+            {
+                p_m = end_m;
+            }
+        }
+
+        const uint8_t* p_m;
+        const uint8_t* end_m;
+    };
+
+    iterator begin() const { return iterator(file_m.data() + frame_log_magic_size, data_end()); }
+    iterator end() const { return iterator(data_end(), data_end()); }
+
+    /// Bytes up to the end of the last whole record
+    size_t valid_size() const
+    {
+        const uint8_t* valid_end = file_m.data() + frame_log_magic_size;
+        for (iterator it = begin(), last = end(); it != last; ++it)
+        {
+            valid_end = it.record_end();
+        }
+        return valid_end - file_m.data();
+    }
+
+  private:
+    const uint8_t* data_end() const { return file_m.data() + file_m.size(); }
+
+    mapped_file file_m;
+};
+
+///
+/// Appends frames to a frame log through a buffer.
+///
+/// Records are collected in memory and written in large blocks by flush(),
+/// or when the buffer is full. An existing log is appended to, after
+/// dropping a torn last record.
+///
+struct frame_log_writer
+{
+    ///
+    /// @param path The log, created when missing
+    /// @param buffer_size Bytes buffered before a write
+    ///
+    /// @throws std::runtime_error when the file cannot be opened or is not a frame log
+    ///
+    explicit frame_log_writer(const std::string& path, size_t buffer_size = 1 << 16)
+      : buffer_size_m(buffer_size)
+    {
+        fd_m = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd_m < 0)
+        {
+            throw std::runtime_error(path + ": " + std::strerror(errno));
+        }
+        struct stat st;
+        if (fstat(fd_m, &st) != 0)
+        {
+            int err = errno;
+            ::close(fd_m);
+            throw std::runtime_error(path + ": " + std::strerror(err));
+        }
+        try {
+            if (st.st_size == 0)
+            {
+                block_writer(fd_m).write(frame_log_magic(), frame_log_magic_size);
+            }
+            else
+            {
+                size_t valid = frame_log_reader(path).valid_size();
+                if (valid != size_t(st.st_size) && ftruncate(fd_m, valid) != 0)
+                {
+                    throw std::runtime_error(path + ": " + std::strerror(errno));
+                }
+            }
+        } catch (...) {
+            ::close(fd_m);
+            throw;
+        }
+        buffer_m.reserve(buffer_size_m + frame_record_t::record_size(0xffff));
+    }
+
+    ~frame_log_writer()
+    {
+        try {
+            flush();
+        } catch (const std::exception&) {
+        }
+        ::close(fd_m);
+    }
+
+    frame_log_writer(const frame_log_writer&) = delete;
+    frame_log_writer& operator=(const frame_log_writer&) = delete;
+
+    ///
+    /// Append a frame.
+    ///
+    /// @param time_ns Reception time, nanoseconds since the Unix epoch
+    /// @param channel Channelizer channel
+    /// @param power_db Frame power in dBFS, NaN when unknown
+    /// @param begin First byte of the frame
+    /// @param end One past the last byte, at most 65535 bytes
+    ///
+    void write(uint64_t time_ns, size_t channel, double power_db, const uint8_t* begin,
+               const uint8_t* end)
+    {
+        frame_record_t record;
+        record.time_ns = time_ns;
+        record.channel = uint16_t(channel);
+        record.power_cdb = frame_record_t::no_power;
+        if (!std::isnan(power_db))
+        {
+            record.power_cdb = int16_t(std::max(-32767.0, std::min(32767.0, std::round(power_db * 100.0))));
+        }
+        record.length = uint16_t(std::min<size_t>(end - begin, 0xffff));
+        record.reserved = 0;
+
+        const uint8_t* header = reinterpret_cast<const uint8_t*>(&record);
+        const size_t offset = buffer_m.size();
+        buffer_m.insert(buffer_m.end(), header, header + sizeof(record));
+        buffer_m.insert(buffer_m.end(), begin, begin + record.length);
+        buffer_m.resize(offset + frame_record_t::record_size(record.length), 0);
+        if (buffer_m.size() >= buffer_size_m) flush();
+    }
+
+    /// Write the buffered records
+    void flush()
+    {
+        if (buffer_m.empty()) return;
+        block_writer(fd_m).write(buffer_m.data(), buffer_m.size());
+        buffer_m.clear();
+    }
+
+  private:
+    int fd_m;
+    size_t buffer_size_m;
+    std::vector<uint8_t> buffer_m;
+};
+
+} // namespace
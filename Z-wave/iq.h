@@ -0,0 +1,300 @@
+//
+// Copyright (C) 2016 Mirko Maischberger <mirko.maischberger@gmail.com>
+//
+// This file is part of WavingZ.
+//
+// WavingZ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// WavingZ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <complex>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <memory>
+#include <string>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace wavingz
+{
+
+///
+/// Converts blocks of interleaved 8 bit IQ pairs into float or double samples.
+///
+/// Each byte is mapped through a 256 entries table built once for the input
+/// format, so converting a block is a pair of loads per sample.
+///
+template <typename T>
+struct iq_converter
+{
+    /// @param unsigned_input cu8 (RTL-SDR) when true, cs8 (HackRF One) otherwise
+    explicit iq_converter(bool unsigned_input)
+    {
+        for (size_t ii(0); ii != table_m.size(); ++ii)
+        {
+            table_m[ii] = unsigned_input ? T(ii) / T(127.0) - T(1.0)
+                                         : T(int8_t(ii)) / T(127.0);
+        }
+    }
+
+    ///
+    /// Convert a block into separate I and Q arrays.
+    ///
+    /// @param begin First byte of the block (I of the first sample)
+    /// @param end One past the last byte, (end - begin) must be even
+    /// @param i Destination of the in-phase values, (end - begin) / 2 of them
+    /// @param q Destination of the quadrature values
+    ///
+    void operator()(const uint8_t* begin, const uint8_t* end, T* i, T* q) const
+    {
+        const size_t n = (end - begin) / 2;
+        for (size_t kk(0); kk != n; ++kk)
+        {
+            i[kk] = table_m[begin[2 * kk]];
+            q[kk] = table_m[begin[2 * kk + 1]];
+        }
+        check_range(i, q, n);
+    }
+
+    /// Convert a block into complex samples
+    void operator()(const uint8_t* begin, const uint8_t* end,
+                    std::complex<T>* out) const
+    {
+        // std::complex<T> is layout compatible with T[2]
+        T* iq = reinterpret_cast<T*>(out);
+        const size_t n = end - begin;
+        for (size_t kk(0); kk != n; ++kk)
+        {
+            iq[kk] = table_m[begin[kk]];
+        }
+        check_range(iq, iq + 1, n / 2, 2);
+    }
+
+  private:
+    /// Debug builds only: no sample may exceed unit magnitude
+    static void check_range(const T* i, const T* q, size_t n, size_t stride = 1)
+    {
+#ifndef NDEBUG
+        T peak = 0;
+        for (size_t kk(0); kk != n; ++kk)
+        {
+            peak = std::max(peak, i[kk * stride] * i[kk * stride] +
+                                  q[kk * stride] * q[kk * stride]);
+        }
+        assert(peak <= T(1.0));
+#endif
+    }
+
+    std::array<T, 256> table_m;
+};
+
+///
+/// Page aligned byte buffer, e.g. the blocks block_reader reads into.
+///
+struct aligned_buffer
+{
+    aligned_buffer() = default;
+
+    /// @throws std::bad_alloc
+    explicit aligned_buffer(size_t size)
+      : size_m(size)
+    {
+        void* p = nullptr;
+        if (posix_memalign(&p, 4096, size) != 0)
+        {
+            throw std::bad_alloc();
+        }
+        data_m.reset(static_cast<uint8_t*>(p));
+    }
+
+    uint8_t* data() { return data_m.get(); }
+    const uint8_t* data() const { return data_m.get(); }
+    size_t size() const { return size_m; }
+
+  private:
+    struct free_deleter
+    {
+        void operator()(uint8_t* p) const { std::free(p); }
+    };
+
+    std::unique_ptr<uint8_t, free_deleter> data_m;
+    size_t size_m = 0;
+};
+
+///
+/// Reads raw IQ bytes from a file descriptor into caller provided blocks
+/// (e.g. ring slots, ideally aligned_buffer).
+///
+/// Every block returned by read() holds a whole number of IQ pairs, an odd
+/// trailing byte (short reads from a pipe) is carried over to the next block.
+///
+struct block_reader
+{
+    /// @param fd The file descriptor to read from (e.g. STDIN_FILENO)
+    explicit block_reader(int fd)
+      : fd_m(fd)
+    {
+    }
+
+    ///
+    /// Fill a block.
+    ///
+    /// Returns as soon as half of the block is filled, or on end of file.
+    ///
+    /// @param out Destination buffer
+    /// @param size Size of the destination buffer, at least 2 bytes
+    ///
+    /// @returns Number of valid bytes in out, always even, 0 on end of file
+    ///
+    size_t read(uint8_t* out, size_t size)
+    {
+        size &= ~size_t(1);
+        size_t filled = 0;
+        if (carry_m)
+        {
+            out[filled++] = half_sample_m;
+            carry_m = false;
+        }
+        while (filled != size)
+        {
+            ssize_t n = ::read(fd_m, out + filled, size - filled);
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("read: ") +
+                                         std::strerror(errno));
+            }
+            if (n == 0) break;
+            filled += n;
+            // hand over what we have as soon as we have a decent amount
+            if (filled >= size / 2) break;
+        }
+        if (filled & 1)
+        {
+            // keep the half sample for the next block
+            half_sample_m = out[--filled];
+            carry_m = true;
+        }
+        return filled;
+    }
+
+  private:
+    int fd_m;
+    bool carry_m = false;
+    uint8_t half_sample_m = 0;
+};
+
+///
+/// Writes raw IQ bytes to a file descriptor, retrying short writes.
+///
+struct block_writer
+{
+    /// @param fd The file descriptor to write to (e.g. STDOUT_FILENO)
+    explicit block_writer(int fd)
+      : fd_m(fd)
+    {
+    }
+
+    /// Write the whole block, throws on error (e.g. a closed pipe)
+    void write(const void* data, size_t size)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        while (size != 0)
+        {
+            ssize_t n = ::write(fd_m, p, size);
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("write: ") +
+                                         std::strerror(errno));
+            }
+            p += n;
+            size -= n;
+        }
+    }
+
+  private:
+    int fd_m;
+};
+
+///
+/// Read-only memory mapping of a recorded capture (.cu8/.cs8).
+///
+/// The kernel is told the mapping is read sequentially, so the demodulator
+/// can run straight over the mapped bytes with read-ahead and no copies.
+///
+struct mapped_file
+{
+    explicit mapped_file(const std::string& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error(path + ": " + std::strerror(errno));
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            int err = errno;
+            ::close(fd);
+            throw std::runtime_error(path + ": " + std::strerror(err));
+        }
+        size_m = st.st_size;
+        mtime_ns_m = uint64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        if (size_m != 0)
+        {
+            void* p = mmap(nullptr, size_m, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED)
+            {
+                int err = errno;
+                ::close(fd);
+                throw std::runtime_error(path + ": " + std::strerror(err));
+            }
+            madvise(p, size_m, MADV_SEQUENTIAL);
+            data_m = static_cast<const uint8_t*>(p);
+        }
+        ::close(fd);
+    }
+
+    ~mapped_file()
+    {
+        if (data_m) munmap(const_cast<uint8_t*>(data_m), size_m);
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    const uint8_t* data() const { return data_m; }
+    size_t size() const { return size_m; }
+
+    /// Last modification, nanoseconds since the Unix epoch
+    uint64_t mtime_ns() const { return mtime_ns_m; }
+
+  private:
+    const uint8_t* data_m = nullptr;
+    size_t size_m = 0;
+    uint64_t mtime_ns_m = 0;
+};
+
+} // namespace
@@ -0,0 +1,194 @@
+//
+// Copyright (C) 2016 Mirko Maischberger <mirko.maischberger@gmail.com>
+//
+// This file is part of WavingZ.
+//
+// WavingZ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// WavingZ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include "wavingz.h"
+#include "iq.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace wavingz
+{
+
+/// A frame decoded from a recorded capture
+struct offline_frame_t
+{
+    uint64_t sample_offset; // sample at which the demodulator reported the frame
+    uint64_t sof_offset;    // sample at the end of the SOF
+    double power_db;        // as in demod::frame_view_t
+    std::vector<uint8_t> payload;
+};
+
+///
+/// Number of samples two consecutive chunks must share.
+///
+/// Twice the longest frame on air (20 bytes preamble, SOF and a 64 bytes
+/// frame at 40kbaud): one frame to be fully contained in the overlap plus
+/// one frame worth of samples to let the filters settle.
+///
+inline size_t
+offline_overlap(size_t sample_rate)
+{
+    const size_t max_frame_bits = (20 + 1 + max_frame_length) * 8;
+    const size_t baud_rate = 40000;
+    return 2 * max_frame_bits * sample_rate / baud_rate;
+}
+
+///
+/// Decode a recorded capture in parallel.
+///
+/// The capture is split in chunks, each decoded by its own demod_nrz on a
+/// pool of threads. A chunk is decoded starting offline_overlap() samples
+/// before its first sample and owns the frames reported inside its own
+/// range, so frames seen twice in the overlap are only reported once.
+///
+/// @param begin First byte of the capture
+/// @param end One past the last byte of the capture
+/// @param unsigned_input cu8 (RTL-SDR) when true, cs8 (HackRF One) otherwise
+/// @param sample_rate The capture sample rate
+/// @param decimation Decimation used by the demodulator
+/// @param jobs Number of threads
+/// @param callback Called with each offline_frame_t, in sample offset order,
+///        from the calling thread
+/// @param chunk_samples Samples per chunk (0 to pick one automatically)
+/// @param squelch Squelch used by each chunk demodulator (none to disable)
+/// @param filter Frame filter used by each chunk demodulator (none to disable)
+///
+/// @returns Number of frames rejected by the filter
+///
+template <typename Demod = demod::demod_nrz, typename Callback>
+size_t
+decode_parallel(const uint8_t* begin, const uint8_t* end, bool unsigned_input,
+                size_t sample_rate, size_t decimation, size_t jobs, Callback callback,
+                size_t chunk_samples = 0,
+                const boost::optional<energy_squelch>& squelch = boost::none,
+                const boost::optional<frame_filter>& filter = boost::none)
+{
+    const uint64_t total = (end - begin) / 2;
+    if (jobs == 0) jobs = 1;
+    if (chunk_samples == 0)
+    {
+        chunk_samples = std::max<uint64_t>(16 * offline_overlap(sample_rate),
+                                           total / (4 * jobs) + 1);
+    }
+    // chunks start on the same decimation phase as a sequential decode
+    chunk_samples += (decimation - chunk_samples % decimation) % decimation;
+    const uint64_t overlap = (offline_overlap(sample_rate) + decimation - 1) /
+                             decimation * decimation;
+    const size_t chunks = (total + chunk_samples - 1) / chunk_samples;
+
+    struct chunk_result_t
+    {
+        std::vector<offline_frame_t> frames;
+        bool done = false;
+    };
+    std::vector<chunk_result_t> results(chunks);
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::atomic<size_t> next_chunk(0);
+    std::atomic<size_t> rejected_frames(0);
+
+    auto decode_chunk = [&](size_t chunk) {
+        const uint64_t first = chunk * uint64_t(chunk_samples);
+        const uint64_t start = first > overlap ? first - overlap : 0;
+        const uint64_t stop = std::min<uint64_t>(total, first + chunk_samples);
+
+        std::vector<offline_frame_t> frames;
+        std::unique_ptr<Demod> demod;
+        demod.reset(new Demod(sample_rate, [&](const demod::frame_view_t& frame) {
+            uint64_t offset = start + frame.sample_offset;
+            if (offset >= first && offset < stop)
+            {
+                frames.push_back(offline_frame_t{ offset, start + frame.sof_offset, frame.power_db,
+                                                  std::vector<uint8_t>(frame.begin, frame.end) });
+            }
+        }, decimation));
+        demod->squelch = squelch;
+        demod->filter = filter;
+
+        std::vector<std::complex<float>> iq(1 << 13);
+        const iq_converter<float> convert_iq(unsigned_input);
+        size_t rejected_before = 0; // in the overlap, counted by the previous chunk
+        for (uint64_t sample = start; sample != stop;)
+        {
+            if (sample == first) rejected_before = demod->rejected_frames;
+            size_t n = std::min<uint64_t>(iq.size(), (sample < first ? first : stop) - sample);
+            convert_iq(begin + 2 * sample, begin + 2 * (sample + n), iq.data());
+            demod->process(iq.data(), iq.data() + n);
+            sample += n;
+        }
+
+        rejected_frames += demod->rejected_frames - rejected_before;
+        std::lock_guard<std::mutex> lock(mutex);
+        results[chunk].frames = std::move(frames);
+        results[chunk].done = true;
+        ready.notify_all();
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t ii(0); ii != std::min(jobs, chunks); ++ii)
+    {
+        pool.emplace_back([&] {
+            for (size_t chunk; (chunk = next_chunk++) < chunks;)
+            {
+                decode_chunk(chunk);
+            }
+        });
+    }
+
+    // report in order as soon as each chunk is complete
+    auto report_chunks = [&] {
+        for (size_t chunk(0); chunk != chunks; ++chunk)
+        {
+            std::vector<offline_frame_t> frames;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [&] { return results[chunk].done; });
+                frames.swap(results[chunk].frames);
+            }
+            for (const auto& frame : frames)
+            {
+                callback(frame);
+            }
+        }
+    };
+
+    std::exception_ptr error;
+    try {
+        report_chunks();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    // stops the pool early on errors
+    next_chunk = chunks;
+    for (auto& thread : pool)
+    {
+        thread.join();
+    }
+    if (error) std::rethrow_exception(error);
+    return rejected_frames;
+}
+
+} // namespace
@@ -0,0 +1,260 @@
+//
+// Copyright (C) 2016 Mirko Maischberger <mirko.maischberger@gmail.com>
+//
+// This file is part of WavingZ.
+//
+// WavingZ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// WavingZ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include "wavingz.h"
+
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <istream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace wavingz
+{
+
+/// A frame of a scenario script
+struct scenario_frame_t
+{
+    bool relative;                // time is the gap after the previous frame
+    double time;                  // seconds
+    std::vector<uint8_t> payload; // checksum included
+};
+
+///
+/// Parse a scenario script.
+///
+/// One frame per line: its time and its bytes in hex, the checksum is added
+/// automatically. A time of "+0.5" starts the frame 0.5s after the end of the
+/// previous one, "12" starts it 12s after the start of the stream. Empty
+/// lines and '#' comments are ignored.
+///
+/// @param in The script
+/// @returns The frames, in script order
+///
+inline std::vector<scenario_frame_t>
+parse_scenario(std::istream& in)
+{
+    std::vector<scenario_frame_t> frames;
+    std::string line;
+    for (size_t number(1); std::getline(in, line); ++number)
+    {
+        auto error = [&](const std::string& what) {
+            return std::runtime_error("line " + std::to_string(number) + ": " + what);
+        };
+
+        std::istringstream fields(line.substr(0, line.find('#')));
+        std::string time;
+        if (!(fields >> time)) continue;
+
+        scenario_frame_t frame;
+        frame.relative = time[0] == '+';
+        size_t used = 0;
+        try {
+            frame.time = std::stod(time.substr(frame.relative), &used);
+        } catch (const std::exception&) {
+            used = 0;
+        }
+        if (used == 0 || used != time.size() - frame.relative || !(frame.time >= 0.0))
+        {
+            throw error("bad time '" + time + "'");
+        }
+
+        for (std::string byte; fields >> byte;)
+        {
+            unsigned long value = 0;
+            try {
+                value = std::stoul(byte, &used, 16);
+            } catch (const std::exception&) {
+                used = 0;
+            }
+            if (used == 0 || used != byte.size() || value > 0xff)
+            {
+                throw error("bad byte '" + byte + "'");
+            }
+            frame.payload.push_back(uint8_t(value));
+        }
+        if (frame.payload.empty() || frame.payload.size() >= max_frame_length)
+        {
+            throw error("a frame has 1 to " + std::to_string(max_frame_length - 1) +
+                        " bytes before the checksum");
+        }
+        frame.payload.push_back(checksum(frame.payload.begin(), frame.payload.end()));
+        frames.push_back(std::move(frame));
+    }
+    return frames;
+}
+
+///
+/// Encode a scenario into a single continuous IQ stream.
+///
+/// Each frame is encoded as a burst (1ms of lead-in, the frame and 1ms for
+/// the filters to ring down) starting at the frame time, the gaps are filled
+/// with silence. Bursts are encoded in parallel on a pool of threads and
+/// handed to the sink in order, at most a few bursts per thread are kept in
+/// memory.
+///
+/// @param frames The frames, as returned by parse_scenario()
+/// @param sample_rate The stream sample rate
+/// @param baud_rate The frames baud rate
+/// @param jobs Number of threads
+/// @param sink Called as sink(const Byte* begin, const Byte* end) with chunks
+///        of interleaved IQ bytes, in order, from the calling thread
+/// @param tail Seconds of silence after the last frame
+/// @param A Amplitude, as for the encoder
+///
+/// @throws std::runtime_error when a frame starts before the end of the
+///         previous one
+///
+template <typename Byte, typename Sink>
+void
+encode_scenario(const std::vector<scenario_frame_t>& frames, size_t sample_rate,
+                size_t baud_rate, size_t jobs, Sink sink, double tail = 1.0,
+                double A = 100.0)
+{
+    // checks the rates before any thread is started
+    const encoder<Byte> prototype(sample_rate, baud_rate, A);
+    if (jobs == 0) jobs = 1;
+
+    struct burst_t
+    {
+        std::vector<Byte> iq;
+        std::exception_ptr error;
+        bool done = false;
+    };
+    const size_t window = 4 * jobs;
+    std::vector<burst_t> bursts(window); // frame ii in bursts[ii % window]
+    std::mutex mutex;
+    std::condition_variable ready, consumed;
+    size_t next_frame = 0;
+    size_t written = 0;
+
+    auto encode_bursts = [&] {
+        encoder<Byte> waver(prototype);
+        for (;;)
+        {
+            size_t frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                consumed.wait(lock, [&] {
+                    return next_frame == frames.size() || next_frame < written + window;
+                });
+                if (next_frame == frames.size()) return;
+                frame = next_frame++;
+            }
+            std::vector<Byte> iq;
+            std::exception_ptr error;
+            try {
+                const auto& payload = frames[frame].payload;
+                waver.encode(payload.begin(), payload.end(), [&](const Byte* begin, const Byte* end) {
+                    iq.insert(iq.end(), begin, end);
+                }, 0.001);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            burst_t& burst = bursts[frame % window];
+            burst.iq.swap(iq);
+            burst.error = error;
+            burst.done = true;
+            ready.notify_all();
+        }
+    };
+
+    std::vector<Byte> silence;
+    const auto silent_sample = complex8_convert<Byte>(A)(0.0, 0.0);
+    for (size_t ii(0); ii != (1 << 16); ++ii)
+    {
+        silence.push_back(silent_sample.first);
+        silence.push_back(silent_sample.second);
+    }
+    auto emit_silence = [&](uint64_t n) {
+        while (n != 0)
+        {
+            size_t m = std::min<uint64_t>(n, silence.size() / 2);
+            sink(silence.data(), silence.data() + 2 * m);
+            n -= m;
+        }
+    };
+
+    // in order, as soon as each burst is encoded
+    auto write_bursts = [&] {
+        uint64_t cursor = 0; // samples handed to the sink
+        for (size_t frame(0); frame != frames.size(); ++frame)
+        {
+            uint64_t start = std::llround(frames[frame].time * sample_rate);
+            if (frames[frame].relative)
+            {
+                start += cursor;
+            }
+            else if (start < cursor)
+            {
+                throw std::runtime_error("frame " + std::to_string(frame + 1) +
+                                         " starts before the end of the previous one");
+            }
+            emit_silence(start - cursor);
+
+            std::vector<Byte> iq;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                burst_t& burst = bursts[frame % window];
+                ready.wait(lock, [&] { return burst.done; });
+                if (burst.error) std::rethrow_exception(burst.error);
+                iq.swap(burst.iq);
+                burst.done = false;
+                ++written;
+            }
+            consumed.notify_all();
+            sink(iq.data(), iq.data() + iq.size());
+            cursor = start + iq.size() / 2;
+        }
+        emit_silence(uint64_t(tail * sample_rate));
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t ii(0); ii != std::min(jobs, frames.size()); ++ii)
+    {
+        pool.emplace_back(encode_bursts);
+    }
+    std::exception_ptr error;
+    try {
+        write_bursts();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    {
+        // stops the pool early on errors
+        std::lock_guard<std::mutex> lock(mutex);
+        next_frame = frames.size();
+    }
+    consumed.notify_all();
+    for (auto& thread : pool)
+    {
+        thread.join();
+    }
+    if (error) std::rethrow_exception(error);
+}
+
+} // namespace
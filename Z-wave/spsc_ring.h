@@ -0,0 +1,179 @@
+//
+// Copyright (C) 2016 Mirko Maischberger <mirko.maischberger@gmail.com>
+//
+// This file is part of WavingZ.
+//
+// WavingZ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// WavingZ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace wavingz
+{
+
+///
+/// Bounded lock-free single-producer/single-consumer ring buffer.
+///
+/// Slots are constructed once and reused in place: the producer fills the
+/// slot returned by write_slot() and publishes it with push(), the consumer
+/// uses the slot returned by read_slot() and hands it back with pop(). This
+/// allows large buffers to travel between threads without copies.
+///
+template <typename T>
+struct spsc_ring
+{
+    /// @param capacity Number of slots, rounded up to a power of two
+    explicit spsc_ring(size_t capacity)
+      : slots_m(round_up(capacity))
+      , mask_m(slots_m.size() - 1)
+    {
+    }
+
+    spsc_ring(const spsc_ring&) = delete;
+    spsc_ring& operator=(const spsc_ring&) = delete;
+
+    // producer side
+
+    /// @returns The next free slot, nullptr when the ring is full
+    T* write_slot()
+    {
+        size_t head = head_m.load(std::memory_order_relaxed);
+        if (head - tail_cache_m == slots_m.size())
+        {
+            tail_cache_m = tail_m.load(std::memory_order_acquire);
+            if (head - tail_cache_m == slots_m.size()) return nullptr;
+        }
+        return &slots_m[head & mask_m];
+    }
+
+    /// Publish the slot returned by write_slot()
+    void push()
+    {
+        size_t head = head_m.load(std::memory_order_relaxed) + 1;
+        head_m.store(head, std::memory_order_release);
+        size_t occupancy = head - tail_m.load(std::memory_order_relaxed);
+        if (occupancy > high_water_m.load(std::memory_order_relaxed))
+        {
+            high_water_m.store(occupancy, std::memory_order_relaxed);
+        }
+    }
+
+    /// Copy a value in, never blocks. @returns false when the ring is full
+    bool try_push(const T& value)
+    {
+        T* slot = write_slot();
+        if (!slot) return false;
+        *slot = value;
+        push();
+        return true;
+    }
+
+    /// No more values will be pushed
+    void close() { closed_m.store(true, std::memory_order_release); }
+
+    // consumer side
+
+    /// @returns The oldest published slot, nullptr when the ring is empty
+    T* read_slot()
+    {
+        size_t tail = tail_m.load(std::memory_order_relaxed);
+        if (tail == head_cache_m)
+        {
+            head_cache_m = head_m.load(std::memory_order_acquire);
+            if (tail == head_cache_m) return nullptr;
+        }
+        return &slots_m[tail & mask_m];
+    }
+
+    /// Release the slot returned by read_slot()
+    void pop()
+    {
+        tail_m.store(tail_m.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_release);
+    }
+
+    ///
+    /// Wait for the next published slot, backing off to short sleeps.
+    ///
+    /// @returns nullptr once the ring is empty and closed
+    ///
+    T* wait_read_slot()
+    {
+        for (size_t spin(0);; ++spin)
+        {
+            bool closed = closed_m.load(std::memory_order_acquire);
+            if (T* slot = read_slot()) return slot;
+            if (closed) return nullptr;
+            backoff(spin);
+        }
+    }
+
+    /// Wait for a free slot (only for producers allowed to block)
+    T* wait_write_slot()
+    {
+        for (size_t spin(0);; ++spin)
+        {
+            if (T* slot = write_slot()) return slot;
+            backoff(spin);
+        }
+    }
+
+    // statistics
+
+    size_t capacity() const { return slots_m.size(); }
+
+    /// Highest occupancy seen by the producer after a push
+    size_t high_water_mark() const
+    {
+        return high_water_m.load(std::memory_order_relaxed);
+    }
+
+  private:
+    static size_t round_up(size_t n)
+    {
+        size_t size = 1;
+        while (size < n) size <<= 1;
+        return size;
+    }
+
+    static void backoff(size_t spin)
+    {
+        if (spin < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::vector<T> slots_m;
+    const size_t mask_m;
+
+    // producer owned
+    alignas(64) std::atomic<size_t> head_m{ 0 };
+    size_t tail_cache_m = 0;
+    std::atomic<size_t> high_water_m{ 0 };
+
+    // consumer owned
+    alignas(64) std::atomic<size_t> tail_m{ 0 };
+    size_t head_cache_m = 0;
+
+    alignas(64) std::atomic<bool> closed_m{ false };
+};
+
+} // namespace
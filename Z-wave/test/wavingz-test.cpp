@@ -1,7 +1,18 @@
 #include "../dsp.h"
 #include "../wavingz.h"
+#include "../offline.h"
+#include "../channelizer.h"
+#include "../iq.h"
+#include "../scenario.h"
+#include "../format.h"
+#include "../frame_log.h"
+#include "../spsc_ring.h"
 
+#include <atomic>
 #include <random>
+#include <thread>
+
+#include <boost/mpl/list.hpp>
 
 #define BOOST_TEST_DYN_LINK
 #define BOOST_TEST_MODULE MyTest
@@ -65,6 +76,146 @@ BOOST_AUTO_TEST_CASE(test_iir_filter)
     }
 }
 
+BOOST_AUTO_TEST_CASE(test_iir_filter_process)
+{
+    std::default_random_engine g;
+    std::normal_distribution<double> gaussian_noise(0.0, 1.0);
+    std::vector<double> signal(1000);
+    for (auto& s : signal) s = gaussian_noise(g);
+
+    iir_filter<3> sample_by_sample(butter_lp<3>(2000000, 50000));
+    iir_filter<3> block(butter_lp<3>(2000000, 50000));
+    std::vector<double> out(signal.size());
+    block.process(signal.data(), out.data(), 300);
+    block.process(signal.data() + 300, out.data() + 300, signal.size() - 300);
+    for (size_t ii(0); ii != signal.size(); ++ii)
+    {
+        BOOST_CHECK_EQUAL(sample_by_sample(signal[ii]), out[ii]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_fir_decimator)
+{
+    std::default_random_engine g;
+    std::normal_distribution<double> gaussian_noise(0.0, 1.0);
+    std::vector<double> signal(1000);
+    for (auto& s : signal) s = gaussian_noise(g);
+
+    auto taps = fir_lp(25, 2000000, 100000);
+    BOOST_CHECK_CLOSE(std::accumulate(taps.begin(), taps.end(), 0.0), 1.0, 1e-9);
+
+    // direct convolution, keeping one output every 4 inputs
+    std::vector<double> expected;
+    for (size_t n(3); n < signal.size(); n += 4)
+    {
+        double y = 0.0;
+        for (size_t k(0); k != taps.size() && k <= n; ++k)
+        {
+            y += taps[k] * signal[n - k];
+        }
+        expected.push_back(y);
+    }
+
+    fir_decimator<double> decimator(4, taps);
+    std::vector<double> out(signal.size());
+    size_t m = decimator.process(signal.data(), 501, out.data());
+    m += decimator.process(signal.data() + 501, signal.size() - 501, out.data() + m);
+    out.resize(m);
+    CHECK_CLOSE_COLLECTION(expected, out, 1e-9);
+}
+
+typedef boost::mpl::list<int8_t, uint8_t> iq_bytes;
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_encoder_templates, Byte, iq_bytes)
+{
+    // the templates give the same bytes as a sample by sample synthesis,
+    // filter ring-down included
+    std::vector<uint8_t> buffer = { 0xd6, 0xb2, 0x62, 0x08, 0x01, 0x41, 0x0f, 0x0d, 0x03, 0x25, 0x01, 0xff };
+    buffer.push_back(wavingz::checksum(buffer.begin(), buffer.end()));
+    std::vector<uint8_t> bits(20, 0x55);
+    bits.push_back(0xF0);
+    bits.insert(bits.end(), buffer.begin(), buffer.end());
+
+    for (size_t sample_rate : { 1600000, 2000000, 4000000 })
+    {
+        wavingz::encoder<Byte> waver(sample_rate, 40000, 100);
+        auto actual = waver(buffer.begin(), buffer.end(), 0.001);
+
+        const size_t Ts = sample_rate / 40000;
+        iir_filter<6> lp1(butter_lp<6>(sample_rate, 50000 * 2.5));
+        iir_filter<6> lp2(butter_lp<6>(sample_rate, 50000 * 2.5));
+        wavingz::complex8_convert<Byte> convert_iq(100);
+        std::vector<std::pair<Byte, Byte>> expected(sample_rate / 1000, convert_iq(0.0, 0.0));
+        size_t sample = 0;
+        for (uint8_t byte : bits)
+        {
+            for (size_t ii(0); ii != 8; ++ii)
+            {
+                double f_shift = ((byte << ii) & 0x80) ? 50000 : 10000;
+                for (size_t kk(0); kk != Ts; ++kk, ++sample)
+                {
+                    expected.push_back(convert_iq(lp1(sin(2.0 * M_PI * f_shift * sample / sample_rate)),
+                                                  lp2(cos(2.0 * M_PI * f_shift * sample / sample_rate))));
+                }
+            }
+        }
+        for (size_t ii(0); ii != sample_rate / 1000; ++ii)
+        {
+            expected.push_back(convert_iq(lp1(0.0), lp2(0.0)));
+        }
+
+        BOOST_REQUIRE_EQUAL(actual.size(), expected.size());
+        BOOST_CHECK(actual == expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_encoder_stream)
+{
+    // the chunks are the vector output, interleaved, in bounded pieces
+    std::vector<uint8_t> buffer = { 0xd6, 0xb2, 0x62, 0x08, 0x01, 0x41, 0x0f, 0x0d, 0x03, 0x25, 0x01, 0xff };
+    buffer.push_back(wavingz::checksum(buffer.begin(), buffer.end()));
+
+    wavingz::encoder<uint8_t> waver(2000000, 40000, 100);
+    auto expected = waver(buffer.begin(), buffer.end(), 0.5);
+
+    std::vector<uint8_t> actual;
+    size_t largest_chunk = 0;
+    waver.encode(buffer.begin(), buffer.end(), [&](const uint8_t* begin, const uint8_t* end) {
+        largest_chunk = std::max<size_t>(largest_chunk, end - begin);
+        actual.insert(actual.end(), begin, end);
+    }, 0.5);
+
+    BOOST_REQUIRE_EQUAL(actual.size(), 2 * expected.size());
+    for (size_t ii(0); ii != expected.size(); ++ii)
+    {
+        BOOST_REQUIRE_EQUAL(actual[2 * ii], expected[ii].first);
+        BOOST_REQUIRE_EQUAL(actual[2 * ii + 1], expected[ii].second);
+    }
+    BOOST_CHECK(largest_chunk < actual.size() / 4);
+}
+
+BOOST_AUTO_TEST_CASE(test_encoder_silence)
+{
+    // seconds of silence: the filters ring down, then the output is constant
+    std::vector<uint8_t> buffer = { 0xd6, 0xb2, 0x62, 0x08, 0x01, 0x41, 0x0f, 0x0d, 0x03, 0x25, 0x01, 0xff };
+    buffer.push_back(wavingz::checksum(buffer.begin(), buffer.end()));
+
+    wavingz::encoder<uint8_t> waver(2000000, 40000, 100);
+    const size_t lead_in = 2000;
+    const size_t frame = (20 + 1 + buffer.size()) * 8 * 50;
+    size_t samples = 0;
+    size_t loud_samples = 0;
+    waver.encode(buffer.begin(), buffer.end(), [&](const uint8_t* begin, const uint8_t* end) {
+        for (; begin != end; begin += 2, ++samples)
+        {
+            if (samples < lead_in + frame + 1000) continue;
+            if (begin[0] != 127 || begin[1] != 127) ++loud_samples;
+        }
+    }, 10.0);
+    BOOST_CHECK_EQUAL(samples, lead_in + frame + 20000000);
+    BOOST_CHECK_EQUAL(loud_samples, 0);
+}
+
 BOOST_AUTO_TEST_CASE(test_encode_decode)
 {
 
@@ -90,6 +241,358 @@ BOOST_AUTO_TEST_CASE(test_encode_decode)
     BOOST_CHECK(called);
 }
 
+BOOST_AUTO_TEST_CASE(test_encode_decode_length)
+{
+    // a frame with a valid length byte is reported with exactly that length,
+    // as soon as its last byte is in
+    std::vector<uint8_t> buffer = { 0xd6, 0xb2, 0x62, 0x08, 0x01, 0x41, 0x03, 13, 0x07, 0x25, 0x01, 0xff };
+    buffer.push_back(wavingz::checksum(buffer.begin(), buffer.end()));
+
+    size_t called = 0;
+    size_t reported_at = 0;
+    std::unique_ptr<wavingz::demod::demod_nrz> zwave;
+    zwave.reset(new wavingz::demod::demod_nrz(2000000, [&](uint8_t* begin, uint8_t* end)
+    {
+        ++called;
+        reported_at = zwave->sample_counter;
+        BOOST_CHECK_EQUAL_COLLECTIONS(begin, end, buffer.begin(), buffer.end());
+    }));
+    wavingz::encoder<int8_t> waver(2000000, 40000, 100);
+    auto complex_bytes = waver(buffer.begin(), buffer.end(), 0.1);
+    for(auto pair: complex_bytes)
+    {
+        (*zwave)(std::complex<double>(double(pair.first)/127.0, double(pair.second)/127.0));
+    }
+    BOOST_CHECK_EQUAL(called, 1);
+    // .001" lead-in, preamble, SOF and payload at 50 samples per symbol
+    const size_t frame_end = 2000 + (20 + 1 + buffer.size()) * 8 * 50;
+    BOOST_CHECK_LT(reported_at, frame_end + 50);
+}
+
+struct recording_sink
+{
+    std::vector<wavingz::demod::frame_view_t>& frames;
+    std::vector<std::vector<uint8_t>>& payloads;
+    void operator()(const wavingz::demod::frame_view_t& frame)
+    {
+        frames.push_back(frame);
+        payloads.emplace_back(frame.begin, frame.end);
+    }
+};
+
+BOOST_AUTO_TEST_CASE(test_frame_sink)
+{
+    std::vector<uint8_t> buffer = { 0xd6, 0xb2, 0x62, 0x08, 0x01, 0x41, 0x03, 13, 0x07, 0x25, 0x01, 0xff };
+    buffer.push_back(wavingz::checksum(buffer.begin(), buffer.end()));
+
+    std::vector<wavingz::demod::frame_view_t> frames;
+    std::vector<std::vector<uint8_t>> payloads;
+    wavingz::demod::basic_demod_nrz<atan_fm_demodulator, recording_sink> zwave(
+        2000000, recording_sink{ frames, payloads }, 8);
+    zwave.channel = 3;
+
+    // amplitude 64/127: about -6dBFS
+    wavingz::encoder<int8_t> waver(2000000, 40000, 64);
+    std::vector<std::complex<float>> iq;
+    for(auto pair: waver(buffer.begin(), buffer.end(), 0.1))
+    {
+        iq.emplace_back(float(pair.first)/127.0f, float(pair.second)/127.0f);
+    }
+    zwave.process(iq.data(), iq.data() + iq.size());
+
+    BOOST_REQUIRE_EQUAL(frames.size(), 1);
+    BOOST_CHECK_EQUAL_COLLECTIONS(payloads[0].begin(), payloads[0].end(), buffer.begin(), buffer.end());
+    BOOST_CHECK_EQUAL(frames[0].channel, 3);
+    BOOST_CHECK_GT(frames[0].sample_offset, 2000 + (20 + 1 + buffer.size()) * 8 * 50 - 100);
+    BOOST_CHECK_LT(frames[0].sample_offset, 2000 + (20 + 1 + buffer.size()) * 8 * 50 + 100);
+    BOOST_CHECK_CLOSE(frames[0].power_db, 20.0 * std::log10(64.0 / 127.0), 10.0);
+}
+
+BOOST_AUTO_TEST_CASE(test_encode_decode_block)
+{
+    std::vector<uint8_t> buffer = { 0xd2, 0xd6, 0x33, 0x22, 0xAA, 0x55, 13, 0xFF, 0x00, 0xFF, 0x00, 0x9f };
+    buffer.push_back(wavingz::checksum(buffer.begin(), buffer.end()));
+
+    size_t called = 0;
+    auto wave_callback = [&](uint8_t* begin, uint8_t* end)
+    {
+        ++called;
+        BOOST_REQUIRE((size_t)(end-begin) >= buffer.size());
+        BOOST_CHECK_EQUAL_COLLECTIONS(begin, begin+begin[6], buffer.begin(), buffer.end());
+    };
+
+    wavingz::demod::demod_nrz zwave(2048000, wave_callback);
+    wavingz::encoder<int8_t> waver(2000000, 40000, 100);
+    std::vector<std::complex<float>> iq;
+    for (size_t ii(0); ii != 2; ++ii)
+    {
+        for(auto pair: waver(buffer.begin(), buffer.end(), 0.1))
+        {
+            iq.emplace_back(float(pair.first)/127.0f, float(pair.second)/127.0f);
+        }
+    }
+    // odd sized blocks, not aligned to the internal block size
+    for (size_t offset(0); offset < iq.size(); offset += 9999)
+    {
+        zwave.process(iq.data() + offset, iq.data() + std::min(iq.size(), offset + 9999));
+    }
+    BOOST_CHECK_EQUAL(called, 2);
+    BOOST_CHECK_EQUAL(zwave.sample_counter, iq.size());
+}
+
+BOOST_AUTO_TEST_CASE(test_encode_decode_decimated)
+{
+    std::vector<uint8_t> buffer = { 0xd2, 0xd6, 0x33, 0x22, 0xAA, 0x55, 13, 0xFF, 0x00, 0xFF, 0x00, 0x9f };
+    buffer.push_back(wavingz::checksum(buffer.begin(), buffer.end()));
+
+    size_t called = 0;
+    auto wave_callback = [&](uint8_t* begin, uint8_t* end)
+    {
+        ++called;
+        BOOST_REQUIRE((size_t)(end-begin) >= buffer.size());
+        BOOST_CHECK_EQUAL_COLLECTIONS(begin, begin+begin[6], buffer.begin(), buffer.end());
+    };
+
+    // 2M samples/s decimated by 8: 6.25 samples per symbol
+    wavingz::demod::demod_nrz block(2000000, wave_callback, 8);
+    wavingz::demod::demod_nrz sample_by_sample(2000000, wave_callback, 8);
+    wavingz::encoder<int8_t> waver(2000000, 40000, 100);
+    std::vector<std::complex<float>> iq;
+    for(auto pair: waver(buffer.begin(), buffer.end(), 0.1))
+    {
+        iq.emplace_back(float(pair.first)/127.0f, float(pair.second)/127.0f);
+        sample_by_sample(iq.back());
+    }
+    block.process(iq.data(), iq.data() + iq.size());
+    BOOST_CHECK_EQUAL(called, 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_channelizer)
+{
+    std::vector<std::vector<uint8_t>> buffers = {
+        { 0xd2, 0xd6, 0x33, 0x22, 0xAA, 0x55, 13, 0xFF, 0x00, 0xFF, 0x00, 0x9f },
+        { 0xd2, 0xd6, 0x33, 0x22, 0x01, 0x41, 12, 0x02, 0x20, 0x01, 0xFF } };
+    for (auto& buffer : buffers)
+    {
+        buffer.push_back(wavingz::checksum(buffer.begin(), buffer.end()));
+    }
+
+    // 4M samples/s capture with two overlapping frames on different channels
+    const size_t sample_rate = 4000000;
+    const std::vector<double> offsets = { 600000.0, -1300000.0 };
+    std::vector<std::complex<float>> iq;
+    for (size_t ch(0); ch != buffers.size(); ++ch)
+    {
+        wavingz::encoder<int8_t> waver(sample_rate, 40000, 50);
+        size_t n = ch * 20000; // the second frame starts during the first one
+        for (auto pair : waver(buffers[ch].begin(), buffers[ch].end(), 0.1))
+        {
+            if (iq.size() <= n) iq.resize(n + 1);
+            auto shift = std::polar(1.0, 2.0 * M_PI * offsets[ch] * n / sample_rate);
+            iq[n++] += std::complex<float>(
+                std::complex<double>(pair.first / 127.0, pair.second / 127.0) * shift);
+        }
+    }
+
+    std::vector<size_t> called(buffers.size());
+    auto sink = [&](const wavingz::demod::frame_view_t& frame) {
+        const size_t ch = frame.channel;
+        BOOST_REQUIRE(ch < buffers.size());
+        ++called[ch];
+        BOOST_REQUIRE((size_t)(frame.end-frame.begin) >= buffers[ch].size());
+        BOOST_CHECK_EQUAL_COLLECTIONS(frame.begin, frame.begin+frame.begin[6], buffers[ch].begin(), buffers[ch].end());
+    };
+    wavingz::channelizer<> channels(sample_rate, offsets, sink, 16);
+    channels.process(iq.data(), iq.data() + iq.size());
+    BOOST_CHECK_EQUAL(called[0], 1);
+    BOOST_CHECK_EQUAL(called[1], 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_encode_decode_few_samples_per_symbol)
+{
+    std::vector<uint8_t> buffer = { 0xd2, 0xd6, 0x33, 0x22, 0xAA, 0x55, 13, 0xFF, 0x00, 0xFF, 0x00, 0x9f };
+    buffer.push_back(wavingz::checksum(buffer.begin(), buffer.end()));
+
+    size_t called = 0;
+    auto wave_callback = [&](uint8_t* begin, uint8_t* end)
+    {
+        ++called;
+        BOOST_REQUIRE((size_t)(end-begin) >= buffer.size());
+        BOOST_CHECK_EQUAL_COLLECTIONS(begin, begin+begin[6], buffer.begin(), buffer.end());
+    };
+
+    // 2M samples/s decimated by 12 and 16: 4.2 and 3.1 samples per symbol
+    wavingz::demod::demod_nrz by_12(2000000, wave_callback, 12);
+    wavingz::demod::demod_nrz by_16(2000000, wave_callback, 16);
+    wavingz::encoder<int8_t> waver(2000000, 40000, 100);
+
+    std::default_random_engine g;
+    std::normal_distribution<double> gaussian_noise(0.0, 1.0);
+    std::vector<std::complex<float>> iq;
+    for (size_t ii(0); ii != 4; ++ii)
+    {
+        for(auto pair: waver(buffer.begin(), buffer.end(), 0.01))
+        {
+            iq.emplace_back(0.1 * gaussian_noise(g) + 0.9 * double(pair.first)/127.0,
+                            0.1 * gaussian_noise(g) + 0.9 * double(pair.second)/127.0);
+        }
+    }
+    by_12.process(iq.data(), iq.data() + iq.size());
+    by_16.process(iq.data(), iq.data() + iq.size());
+    BOOST_CHECK_EQUAL(called, 8);
+}
+
+BOOST_AUTO_TEST_CASE(test_encode_decode_short_preamble)
+{
+    std::vector<uint8_t> buffer = { 0xd2, 0xd6, 0x33, 0x22, 0xAA, 0x55, 13, 0xFF, 0x00, 0xFF, 0x00, 0x9f };
+    buffer.push_back(wavingz::checksum(buffer.begin(), buffer.end()));
+
+    size_t called = 0;
+    auto wave_callback = [&](uint8_t* begin, uint8_t* end)
+    {
+        ++called;
+        BOOST_REQUIRE((size_t)(end-begin) >= buffer.size());
+        BOOST_CHECK_EQUAL_COLLECTIONS(begin, begin+begin[6], buffer.begin(), buffer.end());
+    };
+
+    wavingz::demod::demod_nrz zwave(2000000, wave_callback);
+    wavingz::encoder<int8_t> waver(2000000, 40000, 100);
+    auto complex_bytes = waver(buffer.begin(), buffer.end(), 0.01);
+
+    // keep the 1ms lead-in but only the last 8 of the 160 preamble symbols
+    const size_t lead_in = 2000;
+    const size_t samples_per_symbol = 50;
+    complex_bytes.erase(complex_bytes.begin() + lead_in,
+                        complex_bytes.begin() + lead_in + 152 * samples_per_symbol);
+
+    std::default_random_engine g;
+    std::normal_distribution<double> gaussian_noise(0.0, 1.0);
+    for(auto pair: complex_bytes)
+    {
+        zwave(std::complex<double>(0.1 * gaussian_noise(g) + 0.9 * double(pair.first)/127.0,
+                                   0.1 * gaussian_noise(g) + 0.9 * double(pair.second)/127.0));
+    }
+    BOOST_CHECK_EQUAL(called, 1);
+
+    // noise alone never starts a frame
+    for (size_t ii(0); ii != 200000; ++ii)
+    {
+        zwave(std::complex<double>(0.1 * gaussian_noise(g), 0.1 * gaussian_noise(g)));
+    }
+    BOOST_CHECK_EQUAL(called, 1);
+}
+
+typedef boost::mpl::list<atan_fm_demodulator,
+                         fast_atan_fm_demodulator,
+                         quadricorrelator_fm_demodulator> discriminators;
+
+// sin() of the phase step, the quadricorrelator returns it directly
+template <typename Discriminator>
+double sin_of_step(double d) { return std::sin(d); }
+template <>
+double sin_of_step<quadricorrelator_fm_demodulator>(double d) { return d; }
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_discriminators, Discriminator, discriminators)
+{
+    std::vector<double> i(100), q(100), expected(100), actual(100);
+    Discriminator sample_by_sample, block;
+    for (size_t ii(0); ii != i.size(); ++ii)
+    {
+        // constant amplitude, phase steps of up to 3 rad
+        auto s = std::polar(0.5, ii * (ii % 10) / 3.0);
+        i[ii] = s.real();
+        q[ii] = s.imag();
+        expected[ii] = sample_by_sample(s);
+    }
+    block(i.data(), q.data(), actual.data(), 50);
+    block(i.data() + 50, q.data() + 50, actual.data() + 50, 50);
+    CHECK_CLOSE_COLLECTION(expected, actual, 1e-9);
+
+    atan_fm_demodulator reference;
+    for (size_t ii(0); ii != i.size(); ++ii)
+    {
+        double d = reference(std::complex<double>(i[ii], q[ii]));
+        BOOST_CHECK_SMALL(std::sin(d) - sin_of_step<Discriminator>(actual[ii]), 1e-5);
+    }
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_encode_decode_discriminators, Discriminator, discriminators)
+{
+    std::vector<uint8_t> buffer = { 0xd2, 0xd6, 0x33, 0x22, 0xAA, 0x55, 13, 0xFF, 0x00, 0xFF, 0x00, 0x9f };
+    buffer.push_back(wavingz::checksum(buffer.begin(), buffer.end()));
+
+    size_t called = 0;
+    auto wave_callback = [&](uint8_t* begin, uint8_t* end)
+    {
+        ++called;
+        BOOST_REQUIRE((size_t)(end-begin) >= buffer.size());
+        BOOST_CHECK_EQUAL_COLLECTIONS(begin, begin+begin[6], buffer.begin(), buffer.end());
+    };
+
+    wavingz::demod::basic_demod_nrz<Discriminator> full_rate(2048000, wave_callback);
+    wavingz::demod::basic_demod_nrz<Discriminator> decimated(2000000, wave_callback, 8);
+    wavingz::encoder<int8_t> waver(2000000, 40000, 100);
+
+    std::default_random_engine g;
+    std::normal_distribution<double> gaussian_noise(0.0, 1.0);
+    std::vector<std::complex<float>> iq;
+    for(auto pair: waver(buffer.begin(), buffer.end(), 0.1))
+    {
+        iq.emplace_back(0.1 * gaussian_noise(g) + 0.9 * double(pair.first)/127.0,
+                        0.1 * gaussian_noise(g) + 0.9 * double(pair.second)/127.0);
+    }
+    full_rate.process(iq.data(), iq.data() + iq.size());
+    decimated.process(iq.data(), iq.data() + iq.size());
+    BOOST_CHECK_EQUAL(called, 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_encode_decode_squelch)
+{
+    std::vector<uint8_t> buffer = { 0xd2, 0xd6, 0x33, 0x22, 0xAA, 0x55, 13, 0xFF, 0x00, 0xFF, 0x00, 0x9f };
+    buffer.push_back(wavingz::checksum(buffer.begin(), buffer.end()));
+
+    std::vector<uint64_t> offsets, squelched_offsets;
+    wavingz::demod::demod_nrz zwave(2000000, [&](uint8_t* begin, uint8_t* end) {
+        BOOST_CHECK_EQUAL_COLLECTIONS(begin, begin+begin[6], buffer.begin(), buffer.end());
+        offsets.push_back(zwave.sample_counter);
+    });
+    wavingz::demod::demod_nrz squelched(2000000, [&](uint8_t* begin, uint8_t* end) {
+        BOOST_CHECK_EQUAL_COLLECTIONS(begin, begin+begin[6], buffer.begin(), buffer.end());
+        squelched_offsets.push_back(squelched.sample_counter);
+    });
+    squelched.squelch = energy_squelch(6.0);
+
+    // half a second of noise before each frame
+    std::default_random_engine g;
+    std::normal_distribution<double> gaussian_noise(0.0, 0.02);
+    wavingz::encoder<int8_t> waver(2000000, 40000, 50);
+    std::vector<std::complex<float>> iq;
+    for (size_t ii(0); ii != 2; ++ii)
+    {
+        for (size_t kk(0); kk != 1000000; ++kk)
+        {
+            iq.emplace_back(gaussian_noise(g), gaussian_noise(g));
+        }
+        for(auto pair: waver(buffer.begin(), buffer.end(), 0.1))
+        {
+            iq.emplace_back(gaussian_noise(g) + double(pair.first)/127.0,
+                            gaussian_noise(g) + double(pair.second)/127.0);
+        }
+    }
+    zwave.process(iq.data(), iq.data() + iq.size());
+    squelched.process(iq.data(), iq.data() + iq.size());
+
+    BOOST_REQUIRE_EQUAL(offsets.size(), 2);
+    BOOST_REQUIRE_EQUAL(squelched_offsets.size(), 2);
+    BOOST_CHECK_EQUAL(squelched.sample_counter, iq.size());
+    BOOST_CHECK_CLOSE(squelched.squelch->noise_floor(), 2 * 0.02 * 0.02, 10.0);
+    for (size_t ii(0); ii != 2; ++ii)
+    {
+        // same frame end, give or take a symbol
+        BOOST_CHECK_LT(std::abs(double(offsets[ii]) - double(squelched_offsets[ii])), 50.0);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(test_encode_decode_low_power)
 {
 
@@ -142,3 +645,640 @@ BOOST_AUTO_TEST_CASE(test_encode_decode_noise)
     }
     BOOST_CHECK(called);
 }
+
+BOOST_AUTO_TEST_CASE(test_decode_parallel)
+{
+    std::vector<std::vector<uint8_t>> frames = {
+        { 0xd6, 0xb2, 0x62, 0x08, 0x01, 0x41, 0x03, 0x0d, 0x07, 0x25, 0x01, 0xff },
+        { 0xc3, 0xf6, 0x73, 0xa5, 0x02, 0x41, 0x04, 0x10, 0x01, 0x31, 0x05, 0x01, 0x22, 0x00, 0xe1 },
+        { 0xd2, 0xd6, 0x33, 0x22, 0xAA, 0x55, 13, 0xFF, 0x00, 0xFF, 0x00, 0x9f },
+    };
+
+    std::vector<uint8_t> capture;
+    wavingz::encoder<int8_t> waver(2000000, 40000, 100);
+    for (size_t ii(0); ii != 3 * frames.size(); ++ii)
+    {
+        auto buffer = frames[ii % frames.size()];
+        buffer.push_back(wavingz::checksum(buffer.begin(), buffer.end()));
+        for (auto pair : waver(buffer.begin(), buffer.end(), 0.02))
+        {
+            capture.push_back(pair.first);
+            capture.push_back(pair.second);
+        }
+    }
+
+    std::vector<wavingz::offline_frame_t> sequential;
+    wavingz::decode_parallel(capture.data(), capture.data() + capture.size(), false,
+                             2000000, 1, 1, [&](const wavingz::offline_frame_t& frame) {
+        sequential.push_back(frame);
+    }, capture.size());
+    BOOST_REQUIRE_EQUAL(sequential.size(), 3 * frames.size());
+
+    // chunks much shorter than the capture, so frames fall on every boundary
+    std::vector<wavingz::offline_frame_t> parallel;
+    wavingz::decode_parallel(capture.data(), capture.data() + capture.size(), false,
+                             2000000, 1, 4, [&](const wavingz::offline_frame_t& frame) {
+        parallel.push_back(frame);
+    }, wavingz::offline_overlap(2000000) + 1000);
+
+    BOOST_REQUIRE_EQUAL(parallel.size(), sequential.size());
+    for (size_t ii(0); ii != parallel.size(); ++ii)
+    {
+        BOOST_CHECK_EQUAL(parallel[ii].sample_offset, sequential[ii].sample_offset);
+        BOOST_CHECK_EQUAL_COLLECTIONS(parallel[ii].payload.begin(), parallel[ii].payload.end(),
+                                      sequential[ii].payload.begin(), sequential[ii].payload.end());
+    }
+
+    // frames rejected in the overlaps are counted once
+    wavingz::frame_filter filter;
+    filter.allow_home_ids = { 0xd6b26208 };
+    size_t kept = 0;
+    size_t rejected = wavingz::decode_parallel(capture.data(), capture.data() + capture.size(), false,
+                                               2000000, 1, 4, [&](const wavingz::offline_frame_t&) {
+        ++kept;
+    }, wavingz::offline_overlap(2000000) + 1000, boost::none, filter);
+    BOOST_CHECK_EQUAL(kept, 3);
+    BOOST_CHECK_EQUAL(rejected, 6);
+
+    // a failing callback stops the pool and the error reaches the caller
+    size_t reported = 0;
+    BOOST_CHECK_THROW(wavingz::decode_parallel(capture.data(), capture.data() + capture.size(), false,
+                                               2000000, 1, 4, [&](const wavingz::offline_frame_t&) {
+        if (++reported == 2) throw std::runtime_error("write error");
+    }, wavingz::offline_overlap(2000000) + 1000), std::runtime_error);
+    BOOST_CHECK_EQUAL(reported, 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_encode_scenario)
+{
+    std::istringstream script(
+        "# two frames 10ms apart, then one at 0.1s\n"
+        "0.01 d6 b2 62 08 01 41 03 0d 07 25 01 ff\n"
+        "\n"
+        "+0.01 c3 f6 73 a5 02 41 04 10 01 31 05 01 22 00 e1 # sensor\n"
+        "0.1 d6 b2 62 08 02 41 02 0d 03 25 01 FF\n");
+    auto frames = wavingz::parse_scenario(script);
+    BOOST_REQUIRE_EQUAL(frames.size(), 3);
+    BOOST_CHECK(!frames[0].relative && frames[1].relative && !frames[2].relative);
+    BOOST_CHECK_EQUAL(frames[1].payload.size(), 16);
+    BOOST_CHECK_EQUAL(frames[1].payload.back(),
+                      wavingz::checksum(frames[1].payload.begin(), frames[1].payload.end() - 1));
+
+    std::vector<int8_t> sequential, parallel;
+    wavingz::encode_scenario<int8_t>(frames, 2000000, 40000, 1, [&](const int8_t* begin, const int8_t* end) {
+        sequential.insert(sequential.end(), begin, end);
+    }, 0.01);
+    wavingz::encode_scenario<int8_t>(frames, 2000000, 40000, 3, [&](const int8_t* begin, const int8_t* end) {
+        parallel.insert(parallel.end(), begin, end);
+    }, 0.01);
+    BOOST_CHECK(sequential == parallel);
+
+    // the last burst (2ms and 13 bytes) starts at 0.1s
+    BOOST_CHECK_EQUAL(sequential.size() / 2, 200000 + 4000 + (20 + 1 + 13) * 8 * 50 + 20000);
+
+    std::vector<uint64_t> offsets;
+    wavingz::decode_parallel(reinterpret_cast<const uint8_t*>(sequential.data()),
+                             reinterpret_cast<const uint8_t*>(sequential.data() + sequential.size()),
+                             false, 2000000, 1, 1, [&](const wavingz::offline_frame_t& frame) {
+        offsets.push_back(frame.sample_offset);
+        BOOST_CHECK_EQUAL_COLLECTIONS(frame.payload.begin(), frame.payload.end(),
+                                      frames[offsets.size() - 1].payload.begin(),
+                                      frames[offsets.size() - 1].payload.end());
+    });
+    BOOST_REQUIRE_EQUAL(offsets.size(), 3);
+    BOOST_CHECK(offsets[0] > 20000 && offsets[1] > offsets[0] + 20000 && offsets[2] > 200000);
+
+    std::istringstream overlapping("0.01 d6 b2\n0.011 d6 b2\n");
+    BOOST_CHECK_THROW(wavingz::encode_scenario<int8_t>(wavingz::parse_scenario(overlapping), 2000000, 40000, 2,
+                                                       [](const int8_t*, const int8_t*) {}),
+                      std::runtime_error);
+    std::istringstream bad("0.01 d6 b2 1ff\n");
+    BOOST_CHECK_THROW(wavingz::parse_scenario(bad), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_decode_frame)
+{
+    // Multilevel Sensor Report, temperature 22.5C
+    std::vector<uint8_t> report = { 0xc3, 0xf6, 0x73, 0xa5, 0x02, 0x41, 0x04, 0x10,
+                                    0x01, 0x31, 0x05, 0x01, 0x22, 0x00, 0xe1 };
+    report.push_back(wavingz::checksum(report.begin(), report.end()));
+
+    auto frame = wavingz::decode_frame(report.data(), report.data() + report.size());
+    BOOST_CHECK(frame.complete);
+    BOOST_CHECK(frame.checksum_ok);
+    BOOST_CHECK_EQUAL(frame.home_id(), 0xc3f673a5);
+    BOOST_CHECK_EQUAL(frame.header.source_node_id, 2);
+    BOOST_CHECK_EQUAL(frame.header.dest_node_id, 1);
+    BOOST_CHECK_EQUAL(frame.header.command_class, 0x31);
+    BOOST_CHECK_EQUAL(frame.payload_begin - report.data(), 10);
+    BOOST_CHECK_EQUAL(frame.payload_end - report.data(), 15);
+    BOOST_REQUIRE(frame.measurement.label);
+    BOOST_CHECK_EQUAL(std::string(frame.measurement.label), "Temperature");
+    BOOST_CHECK_CLOSE(frame.measurement.value, 22.5, 1e-9);
+
+    // trailing noise after the announced length is not part of the frame
+    report.push_back(0xff);
+    frame = wavingz::decode_frame(report.data(), report.data() + report.size());
+    BOOST_CHECK(frame.complete && frame.checksum_ok);
+
+    report[14] ^= 1;
+    frame = wavingz::decode_frame(report.data(), report.data() + report.size());
+    BOOST_CHECK(frame.complete);
+    BOOST_CHECK(!frame.checksum_ok);
+
+    frame = wavingz::decode_frame(report.data(), report.data() + 12);
+    BOOST_CHECK(!frame.complete);
+    BOOST_CHECK(!frame.measurement.label);
+
+    // an ACK has no command class nor payload
+    std::vector<uint8_t> ack = { 0xc3, 0xf6, 0x73, 0xa5, 0x01, 0x03, 0x04, 0x0a, 0x02 };
+    ack.push_back(wavingz::checksum(ack.begin(), ack.end()));
+    frame = wavingz::decode_frame(ack.data(), ack.data() + ack.size());
+    BOOST_CHECK(frame.complete && frame.checksum_ok);
+    BOOST_CHECK(frame.payload_begin == frame.payload_end);
+}
+
+BOOST_AUTO_TEST_CASE(test_command_class_registry)
+{
+    size_t size;
+    const wavingz::report_entry_t* entries = wavingz::report_registry(&size);
+    for (size_t ii(1); ii < size; ++ii)
+    {
+        BOOST_CHECK(entries[ii - 1].key < entries[ii].key);
+    }
+
+    auto decode = [](std::vector<uint8_t> report) {
+        return wavingz::decode_report(report.data(), report.data() + report.size());
+    };
+    auto label = [](const wavingz::measurement_t& m) { return std::string(m.label ? m.label : ""); };
+    auto text = [](const char* s) { return std::string(s ? s : ""); };
+
+    // precision 1, Fahrenheit, 2 bytes
+    auto m = decode({ 0x31, 0x05, 0x01, 0x2a, 0x02, 0xd5 });
+    BOOST_CHECK_EQUAL(label(m), "Temperature");
+    BOOST_CHECK_CLOSE(m.value, 72.5, 1e-9);
+    BOOST_CHECK_EQUAL(text(m.unit), "F");
+
+    // precision 0, 1 byte
+    m = decode({ 0x31, 0x05, 0x05, 0x01, 0x2d });
+    BOOST_CHECK_EQUAL(label(m), "Humidity");
+    BOOST_CHECK_CLOSE(m.value, 45.0, 1e-9);
+    BOOST_CHECK_EQUAL(text(m.unit), "%");
+
+    // precision 2, 4 bytes, negative
+    m = decode({ 0x31, 0x05, 0x0b, 0x44, 0xff, 0xff, 0xff, 0x38 });
+    BOOST_CHECK_EQUAL(label(m), "Dew point");
+    BOOST_CHECK_CLOSE(m.value, -2.0, 1e-9);
+
+    // a value shorter than its size byte says is not decoded
+    BOOST_CHECK(!decode({ 0x31, 0x05, 0x01, 0x22, 0x00 }).label);
+
+    // Meter: scale 2 of an electric meter is W
+    m = decode({ 0x32, 0x02, 0x21, 0x34, 0x00, 0x00, 0x04, 0xd2 });
+    BOOST_CHECK_EQUAL(label(m), "Electric meter");
+    BOOST_CHECK_CLOSE(m.value, 123.4, 1e-9);
+    BOOST_CHECK_EQUAL(text(m.unit), "W");
+
+    m = decode({ 0x80, 0x03, 0xff });
+    BOOST_CHECK_EQUAL(label(m), "Battery");
+    BOOST_CHECK_EQUAL(text(m.state), "LOW");
+
+    // 0xff is on for a light or a switch, not a low battery
+    m = decode({ 0x20, 0x03, 0xff });
+    BOOST_CHECK_EQUAL(label(m), "Basic");
+    BOOST_CHECK_EQUAL(text(m.state), "ON");
+    BOOST_CHECK_CLOSE(m.value, 100.0, 1e-9);
+    m = decode({ 0x26, 0x03, 0xff });
+    BOOST_CHECK_EQUAL(label(m), "Level");
+    BOOST_CHECK_EQUAL(text(m.state), "ON");
+    m = decode({ 0x26, 0x03, 0x32 });
+    BOOST_CHECK(!m.state);
+    BOOST_CHECK_CLOSE(m.value, 50.0, 1e-9);
+
+    m = decode({ 0x71, 0x05, 0x00, 0x00, 0x00, 0xff, 0x07, 0x08, 0x00 });
+    BOOST_CHECK_EQUAL(label(m), "Home security");
+    BOOST_CHECK_EQUAL(text(m.state), "MOTION");
+
+    // v1 binary sensor (no type), an unlisted type (glass break) and a typed one
+    m = decode({ 0x30, 0x03, 0xff });
+    BOOST_CHECK_EQUAL(label(m), "Binary sensor");
+    BOOST_CHECK_EQUAL(text(m.state), "DETECTED");
+    m = decode({ 0x30, 0x03, 0x00, 0x0d });
+    BOOST_CHECK_EQUAL(label(m), "Binary sensor");
+    BOOST_CHECK_EQUAL(text(m.state), "IDLE");
+    m = decode({ 0x30, 0x03, 0xff, 0x0a });
+    BOOST_CHECK_EQUAL(label(m), "Door");
+    BOOST_CHECK_EQUAL(text(m.state), "OPEN");
+    m = decode({ 0x30, 0x03, 0x00, 0x06 });
+    BOOST_CHECK_EQUAL(label(m), "Water");
+    BOOST_CHECK_EQUAL(text(m.state), "DRY");
+
+    // only reports are decoded
+    BOOST_CHECK(!decode({ 0x30, 0x02 }).label);
+    BOOST_CHECK(!decode({ 0x99, 0x03, 0x01 }).label);
+}
+
+BOOST_AUTO_TEST_CASE(test_formatters)
+{
+    std::vector<uint8_t> report = { 0xc3, 0xf6, 0x73, 0xa5, 0x02, 0x41, 0x04, 0x10,
+                                    0x01, 0x31, 0x05, 0x01, 0x22, 0x00, 0xe1, 0xbc };
+    auto frame = wavingz::decode_frame(report.data(), report.data() + report.size());
+
+    std::ostringstream out;
+    wavingz::hex_formatter hex_line(out);
+    wavingz::summary_formatter summary(out);
+    hex_line(frame);
+    summary(frame);
+    BOOST_CHECK_EQUAL(out.str(),
+        "c3 f6 73 a5 02 41 04 10 01 31 05 01 22 00 e1 bc \n"
+        "[x] HomeId: c3f673a5, SourceNodeId: 2, FC0: 41, FC1: 4, FC[speed=0 low_power=0 "
+        "ack_request=1 header_type=1 beaming_info=0 seq=4], Length: 16, DestNodeId: 1, "
+        "CommandClass: 31, Payload: 05 01 22 00 e1 \n"
+        "Temperature: 22.5C\n"
+        "\n");
+
+    out.str("");
+    frame = wavingz::decode_frame(report.data(), report.data() + 8);
+    summary(frame);
+    BOOST_CHECK_EQUAL(out.str(), "[ ] \n");
+
+    std::ostringstream log;
+    wavingz::log_formatter log_line(log);
+    log_line(frame);
+    log_line(frame);
+    const std::string lines = log.str();
+    BOOST_CHECK_EQUAL(std::count(lines.begin(), lines.end(), '@'), 2);
+    BOOST_CHECK(lines.find("@c3 f6 73 a5 02 41 04 10 \n") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(test_sof_offset)
+{
+    std::vector<uint8_t> buffer = { 0xd6, 0xb2, 0x62, 0x08, 0x01, 0x41, 0x03, 13, 0x07, 0x25, 0x01, 0xff };
+    buffer.push_back(wavingz::checksum(buffer.begin(), buffer.end()));
+
+    // 12345 samples of silence, the .001" lead-in, the preamble and the SOF
+    wavingz::encoder<int8_t> waver(2000000, 40000, 100);
+    std::vector<std::complex<float>> iq(12345);
+    for (auto pair : waver(buffer.begin(), buffer.end(), 0.01))
+    {
+        iq.emplace_back(float(pair.first) / 127.0f, float(pair.second) / 127.0f);
+    }
+    // plus the delay of the encoder 125kHz shaping filter
+    const double sof_end = 12345 + 2000 + (20 + 1) * 8 * 50 +
+                           iir_filter<6>(butter_lp<6>(2000000, 125000)).group_delay();
+
+    for (size_t decimation : { 1, 8 })
+    {
+        std::vector<uint64_t> sof;
+        wavingz::demod::demod_nrz zwave(2000000, [&](const wavingz::demod::frame_view_t& frame) {
+            sof.push_back(frame.sof_offset);
+            BOOST_CHECK_LT(frame.sof_offset, frame.sample_offset);
+        }, decimation);
+        zwave.process(iq.data(), iq.data() + iq.size());
+        BOOST_REQUIRE_EQUAL(sof.size(), 1);
+        // a few samples, whatever the decimation
+        BOOST_CHECK_SMALL(sof[0] - sof_end, 4.0);
+    }
+
+    // one day at 2M samples/s and a bit, without overflowing
+    const wavingz::sample_clock clock(1458480600000000000ull, 2000000);
+    BOOST_CHECK_EQUAL(clock(0), 1458480600000000000ull);
+    BOOST_CHECK_EQUAL(clock(86400ull * 2000000 + 1), 1458480600000000000ull + 86400000000000ull + 500);
+
+    BOOST_CHECK_EQUAL(wavingz::parse_time_ns("1458480600.25"), 1458480600250000000ull);
+    BOOST_CHECK_EQUAL(wavingz::parse_time_ns("2016-03-20 13:30:00.5"),
+                      wavingz::parse_time_ns("2016-03-20.13:30:00") + 500000000);
+    BOOST_CHECK_EQUAL(wavingz::parse_time_ns("2016-03-20T13:30:00"),
+                      wavingz::parse_time_ns("2016-03-20.13:30:00"));
+    BOOST_CHECK_THROW(wavingz::parse_time_ns("2016-03-20"), std::runtime_error);
+    BOOST_CHECK_THROW(wavingz::parse_time_ns("1458480600.x"), std::runtime_error);
+
+    // the data.txt stamps match strftime across hours and days
+    std::ostringstream log;
+    wavingz::log_formatter log_line(log);
+    const uint8_t ack[] = { 0xc3, 0xf6, 0x73, 0xa5, 0x01, 0x03, 0x04, 0x0a, 0x02, 0x00 };
+    const auto frame = wavingz::decode_frame(ack, ack + sizeof(ack));
+    std::string expected;
+    for (time_t when = 1458480600; when < 1458480600 + 2 * 86400; when += 1237)
+    {
+        log_line(frame, uint64_t(when) * 1000000000 + 999999999);
+        struct tm tstruct;
+        localtime_r(&when, &tstruct);
+        char stamp[80];
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d.%X@", &tstruct);
+        expected += std::string(stamp) + "c3 f6 73 a5 01 03 04 0a 02 00 \n";
+    }
+    BOOST_CHECK_EQUAL(log.str(), expected);
+}
+
+BOOST_AUTO_TEST_CASE(test_frame_filter)
+{
+    const uint8_t header[] = { 0xc3, 0xf6, 0x73, 0xa5, 0x02 };
+    wavingz::frame_filter filter;
+    BOOST_CHECK(filter(header));
+    filter.allow_home_ids = { 0xd6b26208, 0xc3f673a5 };
+    BOOST_CHECK(filter(header));
+    filter.deny_source_nodes = { 0x02 };
+    BOOST_CHECK(!filter(header));
+    filter.deny_source_nodes.clear();
+    filter.allow_source_nodes = { 0x01 };
+    BOOST_CHECK(!filter(header));
+    filter.allow_source_nodes.clear();
+    filter.allow_home_ids = { 0xd6b26208 };
+    BOOST_CHECK(!filter(header));
+
+    // the frame of the other network is dropped, the next one is received
+    std::vector<uint8_t> other = { 0xc3, 0xf6, 0x73, 0xa5, 0x02, 0x41, 0x04, 0x0c, 0x01, 0x20, 0x01 };
+    std::vector<uint8_t> ours = { 0xd6, 0xb2, 0x62, 0x08, 0x01, 0x41, 0x03, 0x0d, 0x07, 0x25, 0x01, 0xff };
+    other.push_back(wavingz::checksum(other.begin(), other.end()));
+    ours.push_back(wavingz::checksum(ours.begin(), ours.end()));
+    wavingz::encoder<int8_t> waver(2000000, 40000, 100);
+    std::vector<std::complex<float>> iq;
+    for (const auto* frame : { &other, &ours, &other })
+    {
+        for (auto pair : waver(frame->begin(), frame->end(), 0.001))
+        {
+            iq.emplace_back(float(pair.first) / 127.0f, float(pair.second) / 127.0f);
+        }
+    }
+
+    std::vector<std::vector<uint8_t>> frames;
+    wavingz::demod::demod_nrz zwave(2000000, [&](uint8_t* begin, uint8_t* end) {
+        frames.emplace_back(begin, end);
+    }, 8);
+    zwave.filter = filter;
+    zwave.process(iq.data(), iq.data() + iq.size());
+    BOOST_REQUIRE_EQUAL(frames.size(), 1);
+    BOOST_CHECK(frames[0] == ours);
+    BOOST_CHECK_EQUAL(zwave.rejected_frames, 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_frame_log)
+{
+    char path[] = "/tmp/wavingz-test-XXXXXX";
+    int fd = mkstemp(path);
+    BOOST_REQUIRE(fd >= 0);
+    ::close(fd);
+
+    std::vector<uint8_t> frame = { 0xc3, 0xf6, 0x73, 0xa5, 0x02, 0x41, 0x04, 0x0c, 0x01, 0x20, 0x01 };
+    {
+        wavingz::frame_log_writer log(path, 64);
+        for (size_t ii(0); ii != 10; ++ii)
+        {
+            log.write(1500000000000000000ull + ii, ii % 3, -0.5 * ii, frame.data(),
+                      frame.data() + frame.size() - ii % 2);
+        }
+        log.write(7, 0, std::nan(""), frame.data(), frame.data());
+    }
+
+    size_t frames = 0;
+    for (const wavingz::frame_log_entry_t entry : wavingz::frame_log_reader(path))
+    {
+        if (frames == 10)
+        {
+            BOOST_CHECK(std::isnan(entry.power_db));
+            BOOST_CHECK(entry.begin == entry.end);
+        }
+        else
+        {
+            BOOST_CHECK_EQUAL(entry.time_ns, 1500000000000000000ull + frames);
+            BOOST_CHECK_EQUAL(entry.channel, frames % 3);
+            BOOST_CHECK_SMALL(entry.power_db + 0.5 * frames, 1e-9);
+            BOOST_REQUIRE_EQUAL(entry.end - entry.begin, frame.size() - frames % 2);
+            BOOST_CHECK(std::equal(entry.begin, entry.end, frame.begin()));
+        }
+        ++frames;
+    }
+    BOOST_CHECK_EQUAL(frames, 11);
+
+    // a torn record is skipped by readers and dropped by the next writer
+    const size_t size = wavingz::frame_log_reader(path).valid_size();
+    BOOST_REQUIRE_EQUAL(truncate(path, size - 3), 0);
+    {
+        wavingz::frame_log_reader log(path);
+        BOOST_CHECK_EQUAL(std::distance(log.begin(), log.end()), 10);
+    }
+    {
+        wavingz::frame_log_writer log(path);
+        log.write(8, 1, 0.0, frame.data(), frame.data() + frame.size());
+    }
+    frames = 0;
+    for (const wavingz::frame_log_entry_t entry : wavingz::frame_log_reader(path))
+    {
+        if (++frames == 11) BOOST_CHECK_EQUAL(entry.time_ns, 8);
+    }
+    BOOST_CHECK_EQUAL(frames, 11);
+
+    // anything else is refused
+    BOOST_REQUIRE_EQUAL(truncate(path, 4), 0);
+    BOOST_CHECK_THROW(wavingz::frame_log_reader reader(path), std::runtime_error);
+    BOOST_CHECK_THROW(wavingz::frame_log_writer writer(path), std::runtime_error);
+    ::unlink(path);
+}
+
+BOOST_AUTO_TEST_CASE(test_spsc_ring)
+{
+    wavingz::spsc_ring<int> ring(3);
+    BOOST_CHECK_EQUAL(ring.capacity(), 4);
+    BOOST_CHECK(!ring.read_slot());
+
+    // FIFO order while the indices wrap around the slots many times
+    int pushed = 0, popped = 0;
+    for (int round(0); round != 100; ++round)
+    {
+        for (int ii(0); ii != 1 + round % 4; ++ii)
+        {
+            BOOST_REQUIRE(ring.try_push(pushed++));
+        }
+        while (int* value = ring.read_slot())
+        {
+            BOOST_CHECK_EQUAL(*value, popped++);
+            ring.pop();
+        }
+    }
+    BOOST_CHECK_EQUAL(popped, pushed);
+
+    // full: no free slot until the oldest one is popped
+    for (int ii(0); ii != 4; ++ii)
+    {
+        int* slot = ring.write_slot();
+        BOOST_REQUIRE(slot);
+        *slot = ii;
+        ring.push();
+    }
+    BOOST_CHECK(!ring.write_slot());
+    BOOST_CHECK(!ring.try_push(4));
+    BOOST_CHECK_EQUAL(ring.high_water_mark(), 4);
+    BOOST_CHECK_EQUAL(*ring.read_slot(), 0);
+    ring.pop();
+    BOOST_CHECK(ring.try_push(4));
+    for (int ii(1); ii != 5; ++ii)
+    {
+        BOOST_REQUIRE(ring.read_slot());
+        BOOST_CHECK_EQUAL(*ring.read_slot(), ii);
+        ring.pop();
+    }
+    BOOST_CHECK(!ring.read_slot());
+}
+
+BOOST_AUTO_TEST_CASE(test_spsc_ring_threads)
+{
+    // a producer waiting on a full ring resumes once a slot is popped
+    {
+        wavingz::spsc_ring<int> ring(2);
+        BOOST_REQUIRE(ring.try_push(0) && ring.try_push(1));
+        std::atomic<bool> written(false);
+        std::thread producer([&] {
+            *ring.wait_write_slot() = 2;
+            ring.push();
+            written = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        BOOST_CHECK(!written);
+        ring.pop();
+        producer.join();
+        BOOST_CHECK(written);
+        BOOST_CHECK_EQUAL(*ring.read_slot(), 1);
+    }
+
+    // a consumer waiting on an empty ring resumes on push, then on close
+    // after draining the slots left
+    {
+        wavingz::spsc_ring<int> ring(4);
+        std::atomic<int> received(0);
+        std::atomic<bool> done(false);
+        std::vector<int> values;
+        std::thread consumer([&] {
+            while (int* value = ring.wait_read_slot())
+            {
+                values.push_back(*value);
+                ring.pop();
+                ++received;
+            }
+            done = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        BOOST_CHECK_EQUAL(received, 0);
+        ring.try_push(7);
+        while (received != 1) std::this_thread::yield();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        BOOST_CHECK(!done);
+        ring.try_push(8);
+        ring.try_push(9);
+        ring.close();
+        consumer.join();
+        BOOST_CHECK(done);
+        BOOST_CHECK(values == std::vector<int>({ 7, 8, 9 }));
+    }
+
+    // stress: every value arrives once and in order
+    {
+        wavingz::spsc_ring<std::pair<uint64_t, uint64_t>> ring(16);
+        const uint64_t count = 1000000;
+        std::thread producer([&] {
+            for (uint64_t ii(0); ii != count; ++ii)
+            {
+                auto* slot = ring.wait_write_slot();
+                *slot = std::make_pair(ii, ii * ii);
+                ring.push();
+            }
+            ring.close();
+        });
+        uint64_t expected = 0;
+        bool in_order = true;
+        while (auto* slot = ring.wait_read_slot())
+        {
+            in_order = in_order && slot->first == expected && slot->second == expected * expected;
+            ++expected;
+            ring.pop();
+        }
+        producer.join();
+        BOOST_CHECK(in_order);
+        BOOST_CHECK_EQUAL(expected, count);
+        BOOST_CHECK_LE(ring.high_water_mark(), ring.capacity());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_block_reader)
+{
+    int fds[2];
+    BOOST_REQUIRE_EQUAL(pipe(fds), 0);
+    wavingz::block_reader reader(fds[0]);
+    wavingz::aligned_buffer block(8);
+    BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(block.data()) % 4096, 0);
+    BOOST_CHECK_EQUAL(block.size(), 8);
+
+    // short writes of odd sizes, every block still holds whole IQ pairs
+    const uint8_t bytes[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+    BOOST_REQUIRE_EQUAL(write(fds[1], bytes, 7), 7);
+    BOOST_REQUIRE_EQUAL(reader.read(block.data(), block.size()), 6);
+    BOOST_CHECK(std::equal(block.data(), block.data() + 6, bytes));
+
+    // the half sample is carried over in front of the next block
+    BOOST_REQUIRE_EQUAL(write(fds[1], bytes + 7, 4), 4);
+    BOOST_REQUIRE_EQUAL(reader.read(block.data(), block.size()), 4);
+    BOOST_CHECK(std::equal(block.data(), block.data() + 4, bytes + 6));
+
+    BOOST_REQUIRE_EQUAL(write(fds[1], bytes + 11, 1), 1);
+    ::close(fds[1]);
+    BOOST_REQUIRE_EQUAL(reader.read(block.data(), block.size()), 2);
+    BOOST_CHECK(std::equal(block.data(), block.data() + 2, bytes + 10));
+    BOOST_CHECK_EQUAL(reader.read(block.data(), block.size()), 0);
+    ::close(fds[0]);
+}
+
+BOOST_AUTO_TEST_CASE(test_mapped_file)
+{
+    char path[] = "/tmp/wavingz-test-XXXXXX";
+    int fd = mkstemp(path);
+    BOOST_REQUIRE(fd >= 0);
+    {
+        wavingz::mapped_file empty(path);
+        BOOST_CHECK_EQUAL(empty.size(), 0);
+        BOOST_CHECK(!empty.data());
+    }
+
+    std::vector<uint8_t> bytes(10001);
+    for (size_t ii(0); ii != bytes.size(); ++ii) bytes[ii] = uint8_t(ii * 7);
+    wavingz::block_writer(fd).write(bytes.data(), bytes.size());
+    ::close(fd);
+    {
+        wavingz::mapped_file capture(path);
+        BOOST_REQUIRE_EQUAL(capture.size(), bytes.size());
+        BOOST_CHECK(std::equal(bytes.begin(), bytes.end(), capture.data()));
+        struct stat st;
+        BOOST_REQUIRE_EQUAL(stat(path, &st), 0);
+        BOOST_CHECK_EQUAL(capture.mtime_ns() / 1000000000, uint64_t(st.st_mtime));
+    }
+    ::unlink(path);
+    BOOST_CHECK_THROW(wavingz::mapped_file missing(path), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_iq_converter)
+{
+    std::vector<uint8_t> block;
+    for (int ii = -80; ii != 80; ++ii)
+    {
+        block.push_back(uint8_t(ii));
+        block.push_back(uint8_t(ii / 2));
+    }
+
+    wavingz::iq_converter<float> signed_iq(false);
+    std::vector<float> i(block.size() / 2), q(block.size() / 2);
+    signed_iq(&block.front(), &block.front() + block.size(), i.data(), q.data());
+    for (size_t kk(0); kk != i.size(); ++kk)
+    {
+        BOOST_CHECK_CLOSE(i[kk], float(int8_t(block[2 * kk])) / 127.0f, 1e-5);
+        BOOST_CHECK_CLOSE(q[kk], float(int8_t(block[2 * kk + 1])) / 127.0f, 1e-5);
+    }
+
+    for (auto& byte : block) byte = uint8_t(int8_t(byte) + 127);
+    wavingz::iq_converter<double> unsigned_iq(true);
+    std::vector<std::complex<double>> iq(block.size() / 2);
+    unsigned_iq(&block.front(), &block.front() + block.size(), iq.data());
+    for (size_t kk(0); kk != iq.size(); ++kk)
+    {
+        BOOST_CHECK_CLOSE(iq[kk].real() + 1.0, double(block[2 * kk]) / 127.0, 1e-12);
+        BOOST_CHECK_CLOSE(iq[kk].imag() + 1.0, double(block[2 * kk + 1]) / 127.0, 1e-12);
+    }
+}
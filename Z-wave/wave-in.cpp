@@ -23,12 +23,25 @@
 
 #include "dsp.h"
 #include "wavingz.h"
+#include "iq.h"
+#include "offline.h"
+#include "channelizer.h"
+#include "spsc_ring.h"
+#include "format.h"
+#include "frame_log.h"
 
 #include <cstdio>
 #include <cstdint>
 #include <complex>
 #include <cassert>
 #include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <memory>
+#include <array>
+#include <thread>
+#include <chrono>
 
 #include <boost/optional.hpp>
 #include <boost/program_options.hpp>
@@ -36,16 +49,39 @@
 using namespace std;
 namespace po = boost::program_options;
 
+// the polynomial atan2 is accurate to a few micro radians, plenty for FSK
+typedef wavingz::demod::basic_demod_nrz<fast_atan_fm_demodulator> wavein_demod;
+
 int
 main(int argc, char** argv)
 {
     size_t sample_rate;
+    std::string file;
+    std::string log_path;
+    std::string start_time;
+    size_t jobs;
+    size_t decimation;
+    double squelch_db;
+    std::vector<double> channels;
+    std::vector<std::string> home_ids, skip_home_ids, sources, skip_sources;
 
     po::options_description desc("WavingZ - Wave-in options");
     desc.add_options()
         ("help,h", "Produce this help message")
         ("sample_rate,s", po::value<size_t>(&sample_rate)->default_value(2000000), "Sample rate (default 2M)")
         ("unsigned,u", "Use unsigned8 (RTL-SDR) instead of signed8 (HackRF One)")
+        ("decimation,d", po::value<size_t>(&decimation)->default_value(1), "Decimation before the FSK discriminator (e.g. 8 at 2M)")
+        ("file,f", po::value<std::string>(&file), "Decode a recorded capture (memory mapped) instead of stdin")
+        ("log,l", po::value<std::string>(&log_path)->default_value("data.log"), "Append the frames to this binary frame log (read it with wave-log)")
+        ("start-time", po::value<std::string>(&start_time), "Time of the first sample, e.g. \"2016-03-20 13:30:00.25\" (local) or Unix seconds (default now, or the --file capture modification time less its duration)")
+        ("channel,c", po::value<std::vector<double>>(&channels)->composing(), "Channel centre frequency relative to the tuned frequency in Hz, repeat to decode several channels (default 0)")
+        ("squelch", po::value<double>(&squelch_db), "Skip the demodulator until the power is this many dB above the noise floor (e.g. 6)")
+        ("home_id", po::value<std::vector<std::string>>(&home_ids)->composing(), "Only keep the frames of this HomeId (hex, e.g. c3f673a5), repeat for several")
+        ("skip_home_id", po::value<std::vector<std::string>>(&skip_home_ids)->composing(), "Drop the frames of this HomeId, repeat for several")
+        ("source", po::value<std::vector<std::string>>(&sources)->composing(), "Only keep the frames sent by this node (hex), repeat for several")
+        ("skip_source", po::value<std::vector<std::string>>(&skip_sources)->composing(), "Drop the frames sent by this node, repeat for several")
+        ("stats", "Print receive pipeline statistics on exit")
+        ("jobs,j", po::value<size_t>(&jobs)->default_value(1), "Threads used to decode a --file capture (0 for all cores)")
        ;
 
     po::variables_map vm;
@@ -61,39 +97,258 @@ main(int argc, char** argv)
         cout << "\n";
         cout << "   hackrf_transfer -f 868420000 -s 2000000 -r data.cs8" << "\n";
         cout << "   ./wave-in -s 2000000 -u < data.cs8" << "\n";
+        cout << "   ./wave-in -s 2000000 --file data.cs8 --jobs 0" << "\n";
+        cout << "\n";
+        cout << "   hackrf_transfer -f 869100000 -s 4000000 -r - | ./wave-in -s 4000000 -d 16 -c -680000 -c 750000" << "\n";
         cout << "\n";
         return 1;
     }
 
     bool unsigned_input = vm.count("unsigned");
-    static  std::ofstream myfile;
-    myfile.open("data.txt");
-  
-    struct process_wavingz {
-        void operator()(uint8_t* begin, uint8_t*end)
-        {
-            wavingz::zwave_print(myfile,std::cout, begin, end) << std::endl;
+
+    // frames of other networks are dropped by the demodulators, after their
+    // first 5 bytes
+    boost::optional<wavingz::frame_filter> filter;
+    if (!home_ids.empty() || !skip_home_ids.empty() || !sources.empty() || !skip_sources.empty())
+    {
+        auto parse = [](const std::string& value, unsigned long max) {
+            size_t used = 0;
+            unsigned long id = 0;
+            try {
+                id = std::stoul(value, &used, 16);
+            } catch (const std::exception&) {
+            }
+            if (used == 0 || used != value.size() || id > max) {
+                throw std::runtime_error("bad id '" + value + "'");
+            }
+            return id;
+        };
+        filter = wavingz::frame_filter();
+        try {
+            for (const auto& id : home_ids) filter->allow_home_ids.push_back(parse(id, 0xffffffff));
+            for (const auto& id : skip_home_ids) filter->deny_home_ids.push_back(parse(id, 0xffffffff));
+            for (const auto& id : sources) filter->allow_source_nodes.push_back(parse(id, 0xff));
+            for (const auto& id : skip_sources) filter->deny_source_nodes.push_back(parse(id, 0xff));
+        } catch (const std::exception& e) {
+            cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
         }
-    } wave_callback;
+    }
+    if (channels.empty()) channels.push_back(0.0);
+    std::unique_ptr<wavingz::frame_log_writer> frame_log;
+    try {
+        frame_log.reset(new wavingz::frame_log_writer(log_path));
+    } catch (const std::exception& e) {
+        cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // each frame is logged raw, decoded once and handed to the formatters
+    wavingz::hex_formatter hex_line(std::cout);
+    wavingz::summary_formatter summary(std::cout);
+    // frames are stamped with the time of their SOF on the sample clock,
+    // which starts at --start-time, when a capture started being recorded
+    // or now when reading stdin
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+    wavingz::sample_clock clock(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count(),
+                                sample_rate);
+    if (vm.count("start-time"))
+    {
+        try {
+            clock.start_ns = wavingz::parse_time_ns(start_time);
+        } catch (const std::exception& e) {
+            cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    size_t reported_frames = 0;
+    auto wave_callback = [&](const uint8_t* begin, const uint8_t* end, size_t channel, double power_db,
+                             uint64_t sof_offset) {
+        ++reported_frames;
+        frame_log->write(clock(sof_offset), channel, power_db, begin, end);
+        const wavingz::decoded_frame_t frame = wavingz::decode_frame(begin, end);
+        hex_line(frame);
+        summary(frame);
+        std::cout.flush();
+    };
 
-    wavingz::demod::demod_nrz wavein(sample_rate, wave_callback);
+    // Receive pipeline: reader (this thread) -> DSP -> frame sink, connected
+    // by lock-free rings. The DSP stage drops frames instead of waiting when
+    // the sink falls behind, so sample intake never blocks on output.
+    struct iq_block_t {
+        wavingz::aligned_buffer storage; // unused when reading from a mapped file
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+    };
+    struct frame_slot_t {
+        size_t channel = 0;
+        double power_db = 0.0;
+        uint64_t sof_offset = 0;
+        size_t size = 0;
+        std::array<uint8_t, wavingz::max_frame_length> data;
+    };
+    const size_t block_size = 1 << 18;
+    wavingz::spsc_ring<iq_block_t> blocks(16);
+    wavingz::spsc_ring<frame_slot_t> frames(1024);
+    size_t dropped_frames = 0;
+
+    // the demodulators write their frames straight into the ring
+    struct frame_writer {
+        wavingz::spsc_ring<frame_slot_t>& frames;
+        size_t& dropped_frames;
+        void operator()(const wavingz::demod::frame_view_t& view) const {
+            frame_slot_t* frame = frames.write_slot();
+            if (!frame) {
+                ++dropped_frames;
+                return;
+            }
+            frame->channel = view.channel;
+            frame->power_db = view.power_db;
+            frame->sof_offset = view.sof_offset;
+            frame->size = std::min<size_t>(view.end - view.begin, frame->data.size());
+            std::copy(view.begin, view.begin + frame->size, frame->data.begin());
+            frames.push();
+        }
+    };
+    typedef wavingz::demod::basic_demod_nrz<fast_atan_fm_demodulator, frame_writer> pipeline_demod;
+    wavingz::channelizer<pipeline_demod> wavein(sample_rate, channels,
+                                                frame_writer{ frames, dropped_frames }, decimation);
+
+    if (vm.count("squelch")) {
+        for (size_t ii(0); ii != wavein.size(); ++ii) {
+            wavein.demod(ii).squelch = energy_squelch(squelch_db);
+        }
+    }
+    for (size_t ii(0); ii != wavein.size(); ++ii) {
+        wavein.demod(ii).filter = filter;
+    }
+
+    // convert and demodulate a block of IQ bytes
+    std::vector<std::complex<float>> iq(block_size / 2);
+    wavingz::iq_converter<float> convert_iq(unsigned_input);
+    auto demodulate = [&](const uint8_t* begin, const uint8_t* end) {
+        while (begin != end) {
+            const uint8_t* block_end = begin + std::min<size_t>(end - begin, 2 * iq.size());
+            convert_iq(begin, block_end, iq.data());
+            wavein.process(iq.data(), iq.data() + (block_end - begin) / 2);
+            begin = block_end;
+        }
+    };
 
-    for(;;) {
-        std::complex<double> iq;
-        char ii, qq;
-        if(!cin.get(ii) || !cin.get(qq)) break;
-        if (unsigned_input)
+    std::unique_ptr<wavingz::mapped_file> capture;
+    if (vm.count("file"))
+    {
+        try {
+            capture.reset(new wavingz::mapped_file(file));
+        } catch (const std::exception& e) {
+            cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (!vm.count("start-time"))
+        {
+            // the capture was last written by its last sample
+            const uint64_t duration_ns = wavingz::sample_clock(0, sample_rate)(capture->size() / 2);
+            clock.start_ns = capture->mtime_ns() - std::min(duration_ns, capture->mtime_ns());
+        }
+        if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+        if (jobs > 1 && (channels.size() > 1 || channels[0] != 0.0))
         {
-            iq.real(double((uint8_t)ii)/127.0 - 1.0);
-            iq.imag(double((uint8_t)qq) / 127.0 - 1.0);
+            cerr << "--jobs is only supported for a single centred channel, decoding on one thread" << std::endl;
         }
-        else
+        else if (jobs > 1)
         {
-            iq.real(double(ii)/127.0);
-            iq.imag(double(qq)/127.0);
+            const uint8_t* begin = capture->data();
+            const uint8_t* end = begin + (capture->size() & ~size_t(1));
+            const size_t rejected_frames = wavingz::decode_parallel<wavein_demod>(begin, end, unsigned_input, sample_rate, decimation, jobs,
+                                     [&](const wavingz::offline_frame_t& frame) {
+                wave_callback(frame.payload.data(), frame.payload.data() + frame.payload.size(), 0,
+                              frame.power_db, frame.sof_offset);
+            }, 0, wavein.demod(0).squelch, filter);
+            if (vm.count("stats"))
+            {
+                // no rings on this path, the chunks are decoded in place
+                cerr << "Decoding threads: " << jobs << "\n";
+                cerr << "Frames: " << reported_frames << "\n";
+                cerr << "Frames filtered out: " << rejected_frames << "\n";
+            }
+            return 0;
+        }
+    }
+
+    std::thread dsp([&] {
+        while (iq_block_t* block = blocks.wait_read_slot()) {
+            demodulate(block->data, block->data + block->size);
+            blocks.pop();
+        }
+        frames.close();
+    });
+
+    auto sink_frames = [&] {
+        while (frame_slot_t* frame = frames.wait_read_slot()) {
+            if (channels.size() > 1) {
+                cout << "Channel " << std::dec << frame->channel << " ("
+                     << channels[frame->channel] << " Hz)" << std::endl;
+            }
+            wave_callback(frame->data.data(), frame->data.data() + frame->size, frame->channel,
+                          frame->power_db, frame->sof_offset);
+            frames.pop();
+            // the log is written in blocks, but is up to date whenever idle
+            if (!frames.read_slot()) frame_log->flush();
+        }
+    };
+    std::thread sink([&] {
+        try {
+            sink_frames();
+        } catch (const std::exception& e) {
+            // e.g. the log disk is full, the DSP stage drops the frames left
+            cerr << e.what() << std::endl;
+        }
+    });
+
+    if (capture)
+    {
+        const size_t size = capture->size() & ~size_t(1);
+        for (size_t offset(0); offset != size;) {
+            iq_block_t* block = blocks.wait_write_slot();
+            block->data = capture->data() + offset;
+            block->size = std::min(block_size, size - offset);
+            offset += block->size;
+            blocks.push();
+        }
+    }
+    else
+    {
+        wavingz::block_reader reader(STDIN_FILENO);
+        try {
+            for (;;) {
+                iq_block_t* block = blocks.wait_write_slot();
+                if (!block->storage.data()) block->storage = wavingz::aligned_buffer(block_size);
+                block->data = block->storage.data();
+                block->size = reader.read(block->storage.data(), block->storage.size());
+                if (block->size == 0) break;
+                blocks.push();
+            }
+        } catch (const std::exception& e) {
+            cerr << e.what() << std::endl;
+        }
+    }
+    blocks.close();
+    dsp.join();
+    sink.join();
+
+    if (vm.count("stats"))
+    {
+        cerr << "IQ blocks ring high water mark: " << blocks.high_water_mark()
+             << "/" << blocks.capacity() << "\n";
+        cerr << "Frames ring high water mark: " << frames.high_water_mark()
+             << "/" << frames.capacity() << "\n";
+        cerr << "Frames: " << reported_frames << "\n";
+        cerr << "Dropped frames: " << dropped_frames << "\n";
+        size_t rejected_frames = 0;
+        for (size_t ii(0); ii != wavein.size(); ++ii) {
+            rejected_frames += wavein.demod(ii).rejected_frames;
         }
-        assert(std::abs(iq) <= 1.0);
-        wavein(iq);
+        cerr << "Frames filtered out: " << rejected_frames << "\n";
     }
     return 0;
 }
@@ -0,0 +1,86 @@
+//
+// Copyright (C) 2016 Mirko Maischberger <mirko.maischberger@gmail.com>
+//
+// This file is part of WavingZ.
+//
+// WavingZ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// WavingZ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Dump the binary frame logs written by wave-in
+
+#include "wavingz.h"
+#include "format.h"
+#include "frame_log.h"
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+
+using namespace std;
+namespace po = boost::program_options;
+
+int
+main(int argc, char* argv[])
+{
+    std::vector<std::string> logs;
+
+    po::options_description desc("WavingZ - Wave-log options");
+    desc.add_options()
+        ("help,h", "Produce this help message")
+        ("log,l", po::value<std::vector<std::string>>(&logs)->composing(), "Frame log written by wave-in, repeat to dump several")
+        ("summary", "Print the frames decoded, as wave-in does, instead of data.txt lines")
+       ;
+    po::positional_options_description positional;
+    positional.add("log", -1);
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+    po::notify(vm);
+
+    if (vm.count("help") || logs.empty()) {
+        cerr << desc << "\n";
+        cerr << "\n";
+        cerr << "Example, the text log read by the python scripts:\n";
+        cerr << "\n";
+        cerr << "     wave-log data.log > data.txt\n";
+        cerr << "\n";
+        return vm.count("help") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    const bool summaries = vm.count("summary");
+    wavingz::log_formatter log_line(std::cout);
+    wavingz::hex_formatter hex_line(std::cout);
+    wavingz::summary_formatter summary(std::cout);
+    for (const auto& path : logs)
+    {
+        try {
+            const wavingz::frame_log_reader log(path);
+            for (const wavingz::frame_log_entry_t entry : log)
+            {
+                const wavingz::decoded_frame_t frame = wavingz::decode_frame(entry.begin, entry.end);
+                if (summaries) {
+                    hex_line(frame);
+                    summary(frame);
+                } else {
+                    log_line(frame, entry.time_ns);
+                }
+            }
+        } catch (const std::exception& e) {
+            cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
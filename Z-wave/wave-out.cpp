@@ -19,6 +19,9 @@
 // FSK @40000bps, NZR, Separation=40KHz
 
 #include "wavingz.h"
+#include "iq.h"
+#include "scenario.h"
+#include "format.h"
 
 #include <vector>
 #include <cstdio>
@@ -28,6 +31,7 @@
 #include <sstream>
 #include <iostream>
 #include <fstream>
+#include <thread>
 #include <boost/program_options.hpp>
 
 using namespace std;
@@ -37,8 +41,10 @@ int
 main(int argc, char* argv[])
 {
     std::string payload;
+    std::string script;
     size_t sample_rate;
     size_t baud_rate;
+    size_t jobs;
 
     po::options_description desc("WavingZ - Wave-out options");
     desc.add_options()
@@ -47,6 +53,8 @@ main(int argc, char* argv[])
         ("sample_rate,s", po::value<size_t>(&sample_rate)->default_value(2000000), "Sample rate (default 2M)")
         ("baud_rate,b", po::value<size_t>(&baud_rate)->default_value(40000), "Baudrate (default 40kbaud)")
         ("unsigned,u", "Produce uint8 output instead if int8")
+        ("script,S", po::value<std::string>(&script), "Encode the frames of a scenario script (- for stdin) into a single stream")
+        ("jobs,j", po::value<size_t>(&jobs)->default_value(1), "Threads used to encode a --script (0 for all cores)")
        ;
 
     po::variables_map vm;
@@ -69,6 +77,48 @@ main(int argc, char* argv[])
         cerr << "\n";
         cerr << "  The Frame Check Sequence (8bit) is added automatically.\n";
         cerr << "\n";
+        cerr << "Script example (one frame per line, '#' comments):\n";
+        cerr << "\n";
+        cerr << "     # 0.5s after the start of the stream\n";
+        cerr << "     0.5  d6 b2 62 08 01 41 0f 0d 03 25 01 ff\n";
+        cerr << "     # 2s after the end of the previous frame\n";
+        cerr << "     +2   d6 b2 62 08 01 41 01 0d 03 25 01 00\n";
+        cerr << "\n";
+        cerr << "     wave-out -S scenario.txt -j 0 > scenario.cs8\n";
+        cerr << "\n";
+        return EXIT_SUCCESS;
+    }
+
+    if (vm.count("script"))
+    {
+        // batch mode: one continuous stream for the whole script
+        try {
+            std::vector<wavingz::scenario_frame_t> frames;
+            if (script == "-") {
+                frames = wavingz::parse_scenario(std::cin);
+            } else {
+                std::ifstream in(script);
+                if (!in) throw std::runtime_error(script + ": cannot open");
+                frames = wavingz::parse_scenario(in);
+            }
+            if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+            wavingz::block_writer out(STDOUT_FILENO);
+            if (vm.count("unsigned")) {
+                wavingz::encode_scenario<uint8_t>(frames, sample_rate, baud_rate, jobs,
+                                                  [&](const uint8_t* begin, const uint8_t* end) {
+                    out.write(begin, end - begin);
+                });
+            } else {
+                wavingz::encode_scenario<int8_t>(frames, sample_rate, baud_rate, jobs,
+                                                 [&](const int8_t* begin, const int8_t* end) {
+                    out.write(begin, end - begin);
+                });
+            }
+            cerr << "Encoded " << frames.size() << " frames" << std::endl;
+        } catch (const std::exception& e) {
+            cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
         return EXIT_SUCCESS;
     }
 
@@ -89,21 +139,32 @@ main(int argc, char* argv[])
         }
     }
     buffer.push_back(wavingz::checksum(buffer.begin(), buffer.end()));
-    std::ofstream file;
-    wavingz::zwave_print(file,std::cerr, &buffer.front(), &buffer.front()+buffer.size()) << std::endl;
+    const wavingz::decoded_frame_t frame = wavingz::decode_frame(buffer.data(), buffer.data() + buffer.size());
+    wavingz::hex_formatter hex_line(std::cerr);
+    wavingz::summary_formatter summary(std::cerr);
+    hex_line(frame);
+    summary(frame);
 
-    // encode and output wavingz buffer
-    if(vm.count("unsigned"))
-    {
-        wavingz::encoder<uint8_t> waver(sample_rate, baud_rate);
-        auto complex_bytes = waver(buffer.begin(), buffer.end());
-        for (auto pair : complex_bytes) std::cout << pair.first << pair.second;
-    }
-    else
-    {
-        wavingz::encoder<int8_t> waving(sample_rate, baud_rate);
-        auto complex_bytes = waving(buffer.begin(), buffer.end());
-        for (auto pair : complex_bytes) std::cout << pair.first << pair.second;
+    // encode and stream the wavingz buffer to stdout
+    wavingz::block_writer out(STDOUT_FILENO);
+    try {
+        if(vm.count("unsigned"))
+        {
+            wavingz::encoder<uint8_t> waver(sample_rate, baud_rate);
+            waver.encode(buffer.begin(), buffer.end(), [&](const uint8_t* begin, const uint8_t* end) {
+                out.write(begin, end - begin);
+            });
+        }
+        else
+        {
+            wavingz::encoder<int8_t> waving(sample_rate, baud_rate);
+            waving.encode(buffer.begin(), buffer.end(), [&](const int8_t* begin, const int8_t* end) {
+                out.write(begin, end - begin);
+            });
+        }
+    } catch (const std::exception& e) {
+        cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
     }
 
     return EXIT_SUCCESS;
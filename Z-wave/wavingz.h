@@ -20,17 +20,20 @@
 #pragma once
 
 #include "dsp.h"
+#include "command_class.h"
 
 #include <boost/optional.hpp>
 
+#include <array>
 #include <bitset>
-#include <iomanip>
+#include <cstddef>
+#include <cstring>
 #include <numeric>
-#include <iostream>
 #include <algorithm>
 #include <functional>
-#include <fstream> 
-#include <time.h>
+#include <limits>
+#include <vector>
+
 namespace wavingz
 {
 
@@ -86,6 +89,44 @@ struct packet_t
 
 static_assert(sizeof(packet_t) == 10, "Assumption broken");
 
+/// Longest frame allowed with the 8 bit checksum (R1 and R2 data rates)
+constexpr size_t max_frame_length = 64;
+
+///
+/// HomeId and source node filter.
+///
+/// The demodulator checks it as soon as the first header_size bytes of a
+/// frame are in, a rejected frame is dropped without receiving the rest of
+/// it. Empty allow lists allow everything, the deny lists are checked
+/// after them.
+///
+struct frame_filter
+{
+    /// Bytes needed by operator(): the HomeId and the source node
+    static constexpr size_t header_size = offsetof(packet_t, fc0);
+
+    std::vector<uint32_t> allow_home_ids;
+    std::vector<uint32_t> deny_home_ids;
+    std::vector<uint8_t> allow_source_nodes;
+    std::vector<uint8_t> deny_source_nodes;
+
+    /// @returns true to keep the frame starting at header
+    bool operator()(const uint8_t* header) const
+    {
+        const uint32_t home_id = uint32_t(header[0]) << 24 | header[1] << 16 | header[2] << 8 | header[3];
+        const uint8_t node = header[4];
+        return listed(allow_home_ids, home_id, true) && !listed(deny_home_ids, home_id, false) &&
+               listed(allow_source_nodes, node, true) && !listed(deny_source_nodes, node, false);
+    }
+
+  private:
+    template <typename T>
+    static bool listed(const std::vector<T>& list, T value, bool when_empty)
+    {
+        return list.empty() ? when_empty : std::find(list.begin(), list.end(), value) != list.end();
+    }
+};
+
 /// Frame Check Sequence Calculator
 template <typename T>
 typename std::iterator_traits<T>::value_type
@@ -94,6 +135,63 @@ checksum(T begin, T end)
     return std::accumulate(begin, end, 0xff, std::bit_xor<uint8_t>());
 }
 
+///
+/// A frame split into its fields by decode_frame().
+///
+/// The pointers refer to the decoded bytes, which must outlive it.
+///
+struct decoded_frame_t
+{
+    const uint8_t* begin; // all the received bytes
+    const uint8_t* end;
+    bool complete;        // the header and all the announced bytes are in
+    bool checksum_ok;
+    packet_t header;      // when complete
+    const uint8_t* payload_begin; // after the command class, checksum excluded
+    const uint8_t* payload_end;
+    measurement_t measurement;
+
+    uint32_t home_id() const
+    {
+        return (uint32_t)header.home_id3 | header.home_id2 << 8 |
+               header.home_id1 << 16 | (uint32_t)header.home_id0 << 24;
+    }
+};
+
+///
+/// Split a frame into its fields: no allocation and no I/O, so the result
+/// can be handed to any number of formatters.
+///
+/// @param begin First byte of the frame
+/// @param end One past the last byte received
+///
+inline decoded_frame_t
+decode_frame(const uint8_t* begin, const uint8_t* end)
+{
+    decoded_frame_t frame;
+    frame.begin = begin;
+    frame.end = end;
+    frame.complete = false;
+    frame.checksum_ok = false;
+    std::memset(&frame.header, 0, sizeof(frame.header));
+    frame.payload_begin = frame.payload_end = end;
+    frame.measurement = { nullptr, 0.0, "", nullptr };
+
+    const size_t size = end - begin;
+    if (size < sizeof(packet_t)) return frame;
+    std::memcpy(&frame.header, begin, sizeof(packet_t));
+    const size_t length = frame.header.length;
+    if (length < sizeof(packet_t) || size < length) return frame;
+
+    frame.complete = true;
+    frame.checksum_ok = checksum(begin, begin + length - 1) == begin[length - 1];
+    frame.payload_end = begin + length - 1;
+    // an ACK has no command class, its checksum is the last header byte
+    frame.payload_begin = std::min(begin + sizeof(packet_t), frame.payload_end);
+    frame.measurement = decode_report(begin + sizeof(packet_t) - 1, frame.payload_end);
+    return frame;
+}
+
 /// Convert double IQ into (unsigned) chars
 template <typename Byte>
 struct complex8_convert
@@ -115,6 +213,23 @@ struct complex8_convert
         }
     }
 
+    /// Convert a block into interleaved IQ bytes, the range is checked once
+    void operator()(const double* i, const double* q, Byte* out, size_t n)
+    {
+        double peak = 0.0;
+        for (size_t ii(0); ii != n; ++ii)
+        {
+            peak = std::max(peak, std::max(std::abs(i[ii]), std::abs(q[ii])));
+        }
+        check_range(peak, peak);
+        const double offset = std::is_signed<Byte>::value ? 0.0 : 127.0;
+        for (size_t ii(0); ii != n; ++ii)
+        {
+            out[2 * ii] = (Byte)(i[ii] * A_m + offset);
+            out[2 * ii + 1] = (Byte)(q[ii] * A_m + offset);
+        }
+    }
+
   private:
     void check_range(double i, double q)
     {
@@ -157,257 +272,277 @@ struct encoder
                 "that the resulting phase will be coherent "
                 "with the (1/2) separation frequency (20KHz).");
         }
+
+        // The carrier phase at the start of a bit repeats every few bits, so
+        // each symbol is one of a few IQ templates: tabulate them once, one
+        // Ts samples slice per bit phase.
+        phases = lcm(carrier_period(f0_mul * dfreq), carrier_period(f1_mul * dfreq));
+        for (size_t symbol(0); symbol != 2; ++symbol)
+        {
+            double f_shift = (symbol ? f1_mul : f0_mul) * dfreq;
+            for (size_t sample(0); sample != phases * Ts; ++sample)
+            {
+                template_i[symbol].push_back(sin(2.0 * M_PI * f_shift * (double)sample / sample_rate));
+                template_q[symbol].push_back(cos(2.0 * M_PI * f_shift * (double)sample / sample_rate));
+            }
+        }
+
+        auto silence = convert_iq(0.0, 0.0);
+        for (size_t ii(0); ii != chunk_samples; ++ii)
+        {
+            silence_page.push_back(silence.first);
+            silence_page.push_back(silence.second);
+        }
     }
 
     /// Encode the payload into an IQ signal (cu8 or cs8 depending on Byte type)
     template <typename It>
     std::vector<std::pair<Byte, Byte>>
     operator()(It payload_begin, It payload_end, double silence = 1.0)
+    {
+        std::vector<std::pair<Byte, Byte>> iq;
+        encode(payload_begin, payload_end, [&](const Byte* begin, const Byte* end) {
+            for (; begin != end; begin += 2) {
+                iq.emplace_back(begin[0], begin[1]);
+            }
+        }, silence);
+        return iq;
+    }
+
+    ///
+    /// Encode the payload into an IQ signal, streamed in chunks.
+    ///
+    /// Memory use is bounded by the longest frame, whatever the silence.
+    ///
+    /// @param payload_begin First byte of the payload
+    /// @param payload_end One past the last byte of the payload
+    /// @param sink Called as sink(const Byte* begin, const Byte* end) with
+    ///        chunks of interleaved IQ bytes (I of the first sample first)
+    /// @param silence Seconds of silence after the frame
+    ///
+    template <typename It, typename Sink>
+    void
+    encode(It payload_begin, It payload_end, Sink&& sink, double silence = 1.0)
     {
         constexpr uint8_t PREAMBLE = 0x55; // 10101010...10101010 frame preamble
         constexpr uint8_t SOF = 0xF0;      // Start of frame mark
 
-        std::vector<std::pair<Byte, Byte>> iq;
-
         // .001" silence
-        for (size_t ii(0); ii != sample_rate / 1000; ++ii) {
-            iq.emplace_back(convert_iq(lp1(0.0), lp2(0.0)));
-        }
+        emplace_silence(sample_rate / 1000, sink);
 
-        size_t sample = 0;
+        // unfiltered frame, the buffers are kept between calls
+        std::vector<double>& i = frame_i;
+        std::vector<double>& q = frame_q;
+        i.clear();
+        q.clear();
+        size_t bit = 0;
 
         // preamble
         for (size_t ii(0); ii != 20; ++ii) {
-            emplace_byte(PREAMBLE, sample, iq);
+            emplace_byte(PREAMBLE, bit, i, q);
         }
 
         // SOF
-        emplace_byte(SOF, sample, iq);
+        emplace_byte(SOF, bit, i, q);
 
         // payload
         for (It ch = payload_begin; ch != payload_end; ++ch) {
-            emplace_byte(*ch, sample, iq);
+            emplace_byte(*ch, bit, i, q);
+        }
+
+        lp1.process(i.data(), i.data(), i.size());
+        lp2.process(q.data(), q.data(), q.size());
+        for (size_t ii(0); ii < i.size(); ii += chunk_samples) {
+            size_t n = std::min(chunk_samples, i.size() - ii);
+            convert_iq(i.data() + ii, q.data() + ii, chunk.data(), n);
+            sink(chunk.data(), chunk.data() + 2 * n);
         }
 
         // silence at the end (it seems that more or less 1" is needed by the HackRF
         // One to complete transmission?)
-        for (size_t ii(0); ii != size_t(silence*sample_rate); ++ii) {
-            iq.emplace_back(convert_iq(lp1(0.0), lp2(0.0)));
-        }
-        return iq;
+        emplace_silence(size_t(silence*sample_rate), sink);
     }
 
 private:
 
-    void emplace_byte(char data, size_t& sample, std::vector<std::pair<Byte,Byte>>& iq)
-    {
-        for (size_t ii(0); ii != 8; ++ii) {
-            double f_shift = (((data << ii) & 0x80) ? f1_mul : f0_mul) * dfreq;
-            for (size_t kk(0); kk != Ts; ++kk) {
-                double i =
-                    lp1(sin(2.0 * M_PI * f_shift * (double)sample / sample_rate));
-                double q =
-                    lp2(cos(2.0 * M_PI * f_shift * (double)sample / sample_rate));
-                iq.emplace_back(convert_iq(i, q));
-                ++sample;
+    /// Append the unfiltered IQ samples of a byte, copied from the templates
+    void emplace_byte(char data, size_t& bit, std::vector<double>& i, std::vector<double>& q)
+    {
+        for (size_t ii(0); ii != 8; ++ii, ++bit) {
+            size_t symbol = ((data << ii) & 0x80) ? 1 : 0;
+            size_t offset = (bit % phases) * Ts;
+            i.insert(i.end(), template_i[symbol].begin() + offset,
+                     template_i[symbol].begin() + offset + Ts);
+            q.insert(q.end(), template_q[symbol].begin() + offset,
+                     template_q[symbol].begin() + offset + Ts);
+        }
+    }
+
+    ///
+    /// Output n samples of silence.
+    ///
+    /// The filters ring down for a few symbols after a frame, then the output
+    /// is a constant: it is copied from a pre-built silence page instead of
+    /// being filtered sample by sample.
+    ///
+    template <typename Sink>
+    void emplace_silence(size_t n, Sink& sink)
+    {
+        // far below the rounding step of the unsigned offset, so the filtered
+        // tail converts to exactly the silence bytes
+        const double quiet = 1e-3 * std::numeric_limits<double>::epsilon() / A;
+        while (n != 0) {
+            size_t m = std::min(chunk_samples, n);
+            size_t ii(0);
+            for (; ii != m && !(lp1.settled(quiet) && lp2.settled(quiet)); ++ii) {
+                auto pair = convert_iq(lp1(0.0), lp2(0.0));
+                chunk[2 * ii] = pair.first;
+                chunk[2 * ii + 1] = pair.second;
+            }
+            if (ii != 0) {
+                sink(chunk.data(), chunk.data() + 2 * ii);
+                n -= ii;
+            } else {
+                lp1.reset();
+                lp2.reset();
+                sink(silence_page.data(), silence_page.data() + 2 * m);
+                n -= m;
             }
         }
     }
 
+    /// Number of bits after which a carrier is back to the same phase
+    size_t carrier_period(double f_shift) const
+    {
+        return sample_rate / gcd(sample_rate, size_t(f_shift) * Ts);
+    }
+
+    static size_t gcd(size_t a, size_t b) { return b ? gcd(b, a % b) : a; }
+    static size_t lcm(size_t a, size_t b) { return a / gcd(a, b) * b; }
+
     const double A = 100;
     complex8_convert<Byte> convert_iq = complex8_convert<Byte>(A);
     const size_t sample_rate;
     const size_t baud_rate;
     const size_t Ts;
     iir_filter<6> lp1, lp2;
+    size_t phases; // bit phases of the templates
+    std::vector<double> template_i[2], template_q[2]; // by symbol, phases * Ts samples
+    std::vector<double> frame_i, frame_q;
+    const size_t chunk_samples = 1 << 16;
+    std::vector<Byte> chunk = std::vector<Byte>(2 * chunk_samples); // interleaved IQ
+    std::vector<Byte> silence_page; // chunk_samples of settled output
     static constexpr size_t dfreq = 20000;
     static constexpr double f0_mul = 0.5;
     static constexpr double f1_mul = 2.5;
 
 };
 
-/// Debug print a packet
-template <typename It>
-inline std::ostream&
-zwave_print(std::ofstream& fout,std::ostream& out, It data_begin, It data_end)
-{   time_t now=time(0);
-    struct tm tstruct;
-    char buf[80];
-    tstruct=*localtime(&now);
-    strftime(buf,sizeof(buf), "%Y-%m-%d.%X", &tstruct);
-    
-    fout<<std::string(buf)<< "@" ;
-    for(auto ch = data_begin; ch != data_end; ++ch)
-       { 
-        fout<<std::hex <<std::setfill('0') <<std::setw(2) << (int)*ch <<' ';
-	out << std::hex << std::setfill('0') << std::setw(2) << (int)*ch << ' ';}
-    out << std::endl;
-    fout << std::endl; 
-
-    size_t len = data_end - data_begin;
-    packet_t& p = *(packet_t*)data_begin;
-    if (len < sizeof(packet_t) || len < p.length)
-    {
-        out << "[ ] ";
-        return out;
-    }
-    else if (checksum(data_begin, data_begin + (size_t)p.length - 1) !=
-             data_begin[p.length - 1])
-    {
-        out << "[ ] ";
-    }
-    else
+///
+/// Wall clock time of input samples: a start time plus the sample offset
+/// divided by the sample rate, so frames are stamped with the exact time
+/// of their SOF, also when replaying a capture.
+///
+struct sample_clock
+{
+    ///
+    /// @param start_ns Time of the first sample, nanoseconds since the Unix epoch
+    /// @param sample_rate The input sample rate
+    ///
+    sample_clock(uint64_t start_ns, size_t sample_rate)
+      : start_ns(start_ns)
+      , sample_rate(sample_rate)
     {
-        out << "[x] ";
-    }
-    out << std::hex << std::setfill('0') << std::setw(2)
-        << "HomeId: " << ((uint32_t)p.home_id3 | p.home_id2 << 8 |
-                          p.home_id1 << 16 | p.home_id0 << 24)
-        << ", SourceNodeId: " << (int)p.source_node_id << std::hex
-        << ", FC0: " << (int)p.fc0 << ", FC1: " << (int)p.fc1 << std::dec
-        << ", FC[speed=" << p.frame_control_0.speed
-        << " low_power=" << p.frame_control_0.low_power
-        << " ack_request=" << p.frame_control_0.ack_request
-        << " header_type=" << p.frame_control_0.header_type
-        << " beaming_info=" << p.frame_control_1.beaming_info
-        << " seq=" << p.frame_control_1.sequence_number
-        << "], Length: " << std::dec << (int)p.length
-        << ", DestNodeId: " << std::dec << (int)p.dest_node_id
-        << ", CommandClass: " << std::hex << (int)p.command_class
-        << ", Payload: " << std::hex << std::setfill('0');
-    for (int i = sizeof(packet_t); i < p.length - 1; i++) {
-        out << std::setw(2) << (int)data_begin[i] << " ";
-    }
-     out<<std::endl;
-    if((int)data_begin[9]==0x31&&(int)data_begin[10]==0x05){
-    if((int)data_begin[11]==0x01){
-      if((int)data_begin[12]==0x22) {
-            std::bitset<8> set1(data_begin[13]);
-	    std::bitset<8> set2(data_begin[14]);
-            int base=1;
-            int sum=0;
-            for (int i=0;i<set2.size();i++) {
-                    if(set2.test(i))
-		{sum+=base;base=base*2;}
-                else {sum+=0;base=base*2;}
-}           
-            for (int i=0;i<set1.size();i++) {
-                if (set1.test(i)) {sum+=base;base=base*2;}
-                else {sum+=0; base=base*2;}
-
-}      
-            double temp=sum/10.0;
-              out<<"Temperature: "<<std::dec<<temp<<"C"<<std::endl;
-}     if((int)data_begin[12]==0x2a){
-            std::bitset<8> set1(data_begin[13]);
-            std::bitset<8> set2(data_begin[14]);
-            int sum=0;
-            int base=1;
-            for (int i=0;i<set2.size();i++){
-                  out<<set2.test(i); if(set2.test(i)) {sum+=base;base=base*2;}
-                else {sum+=0;base=base*2;}
-}           for (int i=0;i<set1.size();i++) {
-                if (set1.test(i)) {sum+=base;base=base*2;}
-                else {sum+=0;base=base*2;}
-}
-	    double temp=(sum/10.0-32)*5/9;
-            out<<"Temperature: "<<std::dec<<temp<<"C"<<std::endl;
-}
-
+    }
 
-}   else if ((int)data_begin[11]==0x03) {
-	 if((int)data_begin[12]==0x0a) {
-                std::bitset<8> set1(data_begin[13]);
-                std::bitset<8> set2(data_begin[14]);
-                int sum=0;
-                int base=1;
-                for (int i=0;i<set2.size();i++) {
-                 if (set2.test(i)) {sum+=base;base=base*2;}
-                  else {sum+=0;base=base*2;}
-}              for (int i=set1.size()-1;i>=0;i--) {
-                if (set1.test(i)) {sum+=base;base=base*2;}
-                else {sum+=0;base=base*2;}
-}
-             
-		out<<"Luminance: "<<std::dec<<sum<<"Lux"<<std::endl;
-}}
-    else if ((int)data_begin[11]==0x05) {
-         if((int)data_begin[12]==0x01) {
-           
-              std::bitset<8> set2(data_begin[13]);
-                int sum=0;
-                int base=1;
-                for (int i=0;i<set2.size();i++) {
-               
-		 if (set2.test(i)) {sum+=base;base=base*2;}
-                  else {sum+=0;base=base*2;}
-}              
-            out<<"Humidity: "<<std::dec<<sum<<"%"<<std::endl;
-}  
-}
-    else if ((int)data_begin[11]==0x1b){
-         if((int)data_begin[12]==0x01){
-                std::bitset<8> set2(data_begin[13]);
-                int sum=0;
-                int base=1;
-                for (int i=0;i<set2.size();i++) {
-                  if (set2.test(i)) {sum+=base;base=base*2;}
-                  else {sum+=0;base=base*2;}
-}             
-		out<<"Ultraviolet: "<<std::dec<<sum<<"UV"<<std::endl;
-}
-}
-}   if((int)data_begin[9]==0x30) {
-       // out<<"ahahahahah"<<std::endl;   
-     if((int)data_begin[11]==0x00){
-           out<<"Door CLOSED"<<std::endl;
-}       else if ((int)data_begin[11]==0xff) {
-           out<<"Door OPEN"<<std::endl;
+    /// @returns The time of a sample in nanoseconds since the Unix epoch
+    uint64_t operator()(uint64_t sample_offset) const
+    {
+        // split so the product does not overflow on months long streams
+        const uint64_t ns_per_s = 1000000000;
+        return start_ns + sample_offset / sample_rate * ns_per_s +
+               sample_offset % sample_rate * ns_per_s / sample_rate;
+    }
 
-}
-}
-    return out;
-}
+    uint64_t start_ns;
+    size_t sample_rate;
+};
 
 // demodulation state machine
 namespace demod
 {
+
+/// A decoded frame and what the demodulator measured while receiving it
+struct frame_view_t
+{
+    uint8_t* begin;
+    uint8_t* end;
+    uint64_t sample_offset; // input sample at which the frame was reported
+    uint64_t sof_offset;    // input sample at the end of the SOF (start of the payload)
+    size_t channel;         // channelizer channel (0 with a single channel)
+    double power_db;        // mean channel filtered power over the frame (dBFS)
+};
+
+///
+/// Frame sink calling a std::function, for callers that do not need the
+/// sink to be inlined.
+///
+/// Accepts callables taking either the frame bytes (begin, end) or the
+/// whole frame_view_t.
+///
+struct function_sink
+{
+    function_sink(std::function<void(uint8_t* begin, uint8_t* end)> callback)
+      : callback([callback](const frame_view_t& frame) { callback(frame.begin, frame.end); })
+    {
+    }
+
+    function_sink(std::function<void(const frame_view_t& frame)> callback)
+      : callback(std::move(callback))
+    {
+    }
+
+    void operator()(const frame_view_t& frame) const { callback(frame); }
+
+    std::function<void(const frame_view_t& frame)> callback;
+};
+
 namespace state_machine
 {
-struct symbol_sm_t;
 
 // -----------------------------------------------------------------------------
+//
+// The states are plain structs stored inline in their state machine, the
+// current one is selected by an enum: no allocation, virtual call or RTTI
+// on a transition or on a sample.
+//
+// Frames are found by the start of frame detector of the demodulator, which
+// moves both state machines straight to the payload with the symbol timing
+// already known.
+//
 
 namespace symbol_sm
 {
 
-struct state_base_t
+enum class state_t : uint8_t
 {
-    virtual void process(symbol_sm_t& ctx, const boost::optional<bool>& symbol) = 0;
-};
-
-// Detecting the first nibble of the SOF (0xF)
-struct start_of_frame_1_t : public state_base_t
-{
-    void process(symbol_sm_t& ctx, const boost::optional<bool>& symbol) override;
-private:
-    size_t cnt = 0;
+    idle,
+    payload
 };
 
-// Parsing the second nibble of the SOF (0x0)
-struct start_of_frame_0_t : public state_base_t
+// Between frames, symbols are ignored
+struct idle_t
 {
-    void process(symbol_sm_t& ctx, const boost::optional<bool>& symbol) override;
-private:
-    size_t cnt = 0;
+    template <typename Ctx>
+    void process(Ctx& ctx, const boost::optional<bool>& symbol);
 };
 
 // Pushing data into payload
-struct payload_t : public state_base_t
+struct payload_t
 {
-    void process(symbol_sm_t& ctx, const boost::optional<bool>& symbol) override;
+    template <typename Ctx>
+    void process(Ctx& ctx, const boost::optional<bool>& symbol);
 private:
-    std::vector<uint8_t> payload;
     std::bitset<8> b = 0;
     size_t cnt = 0;
 };
@@ -416,140 +551,672 @@ private:
 
 // -----------------------------------------------------------------------------
 
+///
+/// Symbols to frames.
+///
+/// The Sink is called with the bytes of each frame, (uint8_t* begin,
+/// uint8_t* end); it is stored by value and called directly, so it can be
+/// inlined. Its accept(const uint8_t* header) is asked once the first
+/// frame_filter::header_size bytes are in, the rest of a frame it does not
+/// accept is ignored.
+///
+template <typename Sink>
 struct symbol_sm_t
 {
-    symbol_sm_t(const std::function<void(uint8_t*, uint8_t*)>& callback)
-      : callback(callback)
-      , current_state_m(new symbol_sm::start_of_frame_1_t())
+    symbol_sm_t(const Sink& sink)
+      : sink(sink)
     {
     }
     // sample can be 0, 1 or none (no signal)
-    void process(const boost::optional<bool>& symbol);
-    void state(std::unique_ptr<symbol_sm::state_base_t>&& next_state);
-    std::function<void(uint8_t*, uint8_t*)> callback;
-private:
-    std::unique_ptr<symbol_sm::state_base_t> current_state_m;
-};
+    void process(const boost::optional<bool>& symbol)
+    {
+        switch (current_state_m)
+        {
+        case symbol_sm::state_t::idle:
+            idle_m.process(*this, symbol);
+            break;
+        case symbol_sm::state_t::payload:
+            payload_state_m.process(*this, symbol);
+            break;
+        }
+    }
 
-struct sample_sm_t;
+    void state(const symbol_sm::idle_t& next_state)
+    {
+        idle_m = next_state;
+        current_state_m = symbol_sm::state_t::idle;
+    }
 
-// -----------------------------------------------------------------------------
+    void state(const symbol_sm::payload_t& next_state)
+    {
+        payload_state_m = next_state;
+        payload_size_m = 0;
+        current_state_m = symbol_sm::state_t::payload;
+    }
 
-namespace sample_sm
-{
+    symbol_sm::state_t state() const { return current_state_m; }
 
-struct state_base_t
-{
-    virtual void process(sample_sm_t& ctx, const boost::optional<bool>& sample) = 0;
+    // payload under construction
+    void push(uint8_t byte) { payload_m[payload_size_m++] = byte; }
+    void emit() { sink(payload_m.data(), payload_m.data() + payload_size_m); }
+    bool accept() { return sink.accept(payload_m.data()); }
+    size_t size() const { return payload_size_m; }
+
+    /// true once the frame holds as many bytes as its length byte announces
+    bool complete() const
+    {
+        if (payload_size_m == payload_m.size())
+        {
+            return true;
+        }
+        if (payload_size_m <= offsetof(packet_t, length))
+        {
+            return false;
+        }
+        // a length that cannot be right is ignored, the frame then ends on
+        // signal loss (or when the buffer is full) as it used to
+        size_t length = payload_m[offsetof(packet_t, length)];
+        return length > offsetof(packet_t, dest_node_id) &&
+               length <= payload_m.size() && payload_size_m == length;
+    }
+
+    Sink sink;
+private:
+    symbol_sm::state_t current_state_m = symbol_sm::state_t::idle;
+    symbol_sm::idle_t idle_m;
+    symbol_sm::payload_t payload_state_m;
+    std::array<uint8_t, max_frame_length> payload_m;
+    size_t payload_size_m = 0;
 };
 
-struct idle_t : public state_base_t
+namespace symbol_sm
 {
-    void process(sample_sm_t& ctx, const boost::optional<bool>& sample) override;
-};
 
-struct lead_in_t : public state_base_t
+template <typename Ctx>
+void
+idle_t::process(Ctx&, const boost::optional<bool>&)
 {
-    lead_in_t(bool last_sample)
-      : counter(0)
-      , last_sample(last_sample)
+}
+
+template <typename Ctx>
+void
+payload_t::process(Ctx& ctx, const boost::optional<bool>& symbol)
+{
+    if (symbol == boost::none)
     {
+        if (ctx.size()) ctx.emit();
+        ctx.state(idle_t());
     }
-    void process(sample_sm_t& ctx, const boost::optional<bool>& sample) override;
-private:
-    size_t counter;
-    bool last_sample;
+    else
+    {
+        b[7 - cnt++] = *symbol;
+        if (cnt == b.size())
+        {
+            ctx.push(uint8_t(b.to_ulong()));
+            b.reset();
+            cnt = 0;
+            // frames filtered out by HomeId or source node are dropped
+            // before the rest of their payload
+            if (ctx.size() == frame_filter::header_size && !ctx.accept())
+            {
+                ctx.state(idle_t());
+            }
+            // report the frame as soon as the announced length is in
+            else if (ctx.complete())
+            {
+                ctx.emit();
+                ctx.state(idle_t());
+            }
+        }
+    }
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+
+namespace sample_sm
+{
+
+enum class state_t : uint8_t
+{
+    idle,
+    bitlock
 };
 
-struct preamble_t : public state_base_t
+// Waiting for the start of frame detector
+struct idle_t
 {
-    preamble_t(bool last_sample)
-        : last_sample(last_sample)
-    {}
-    void process(sample_sm_t& ctx, const boost::optional<bool>& sample) override;
-    size_t symbols_counter = 0;
-    size_t samples_counter = 0;
-    bool last_sample;
+    template <typename Ctx>
+    void process(Ctx& ctx, const boost::optional<double>& sample);
 };
 
-struct bitlock_t : public state_base_t
+///
+/// Symbol timing recovery.
+///
+/// A Gardner timing error detector steers the strobes (one at each symbol
+/// centre, one half way between symbols), which are linearly interpolated
+/// between samples: 2 to 4 samples per symbol are enough.
+///
+struct bitlock_t
 {
-    bitlock_t(double samples_per_symbol, bool last_sample)
+    ///
+    /// @param samples_per_symbol Nominal symbol period
+    /// @param next_strobe Samples from the last sample to the first symbol centre
+    /// @param last_sample The last sample
+    /// @param last_symbol The symbol before the first one
+    ///
+    bitlock_t(double samples_per_symbol = 0.0, double next_strobe = 0.0,
+              double last_sample = 0.0, double last_symbol = 0.0)
       : samples_per_symbol(samples_per_symbol)
-      , num_samples(3.0 * samples_per_symbol / 4.0),
-        last_sample(last_sample)
+      , nominal_samples_per_symbol(samples_per_symbol)
+      , next_strobe(next_strobe)
+      , last_sample(last_sample)
+      , last_symbol(last_symbol)
+      , amplitude(std::abs(last_symbol))
     {}
-    void process(sample_sm_t& ctx, const boost::optional<bool>& sample) override;
-    const double samples_per_symbol;
-    double num_samples;
-    bool last_sample;
+    template <typename Ctx>
+    void process(Ctx& ctx, const boost::optional<double>& sample);
+    double samples_per_symbol;
+    double nominal_samples_per_symbol;
+    double next_strobe; // samples from the last sample to the next strobe
+    double last_sample;
+    double last_symbol;
+    double mid_symbol = 0.0; // strobe between last_symbol and the next one
+    double amplitude;
+    bool mid_strobe = false;
 };
 
 } // namespace
 
 // -----------------------------------------------------------------------------
 
+///
+/// Samples to symbols, the symbols are passed to SymbolSink::process()
+/// (a symbol_sm_t).
+///
+template <typename SymbolSink>
 struct sample_sm_t
 {
-    sample_sm_t(size_t sample_rate, symbol_sm_t& sym_sm);
-    // sample can be 0, 1 or none (no signal)
-    void process(const boost::optional<bool>& sample);
-    void state(std::unique_ptr<sample_sm::state_base_t>&& next_state);
-    bool preamble() { return
-            typeid(*current_state_m.get()) == typeid(sample_sm::preamble_t) ||
-            typeid(*current_state_m.get()) == typeid(sample_sm::lead_in_t);
-    }
-    bool idle() { return typeid(*current_state_m.get()) == typeid(sample_sm::idle_t); }
-    void emit(const boost::optional<bool>& symbol);
+    sample_sm_t(size_t sample_rate, SymbolSink& sym_sm)
+      : sample_rate(sample_rate)
+      , sym_sm(sym_sm)
+    {
+    }
+
+    // holds a reference to its symbol state machine
+    sample_sm_t(const sample_sm_t&) = delete;
+    sample_sm_t& operator=(const sample_sm_t&) = delete;
+    sample_sm_t(sample_sm_t&&) = delete;
+    sample_sm_t& operator=(sample_sm_t&&) = delete;
+    // soft sample, > 0 for a '1', or none (no signal)
+    void process(const boost::optional<double>& sample)
+    {
+        switch (current_state_m)
+        {
+        case sample_sm::state_t::idle:
+            idle_m.process(*this, sample);
+            break;
+        case sample_sm::state_t::bitlock:
+            bitlock_m.process(*this, sample);
+            break;
+        }
+    }
+
+    void state(const sample_sm::idle_t& next_state)
+    {
+        idle_m = next_state;
+        current_state_m = sample_sm::state_t::idle;
+    }
+
+    void state(const sample_sm::bitlock_t& next_state)
+    {
+        bitlock_m = next_state;
+        current_state_m = sample_sm::state_t::bitlock;
+    }
+
+    sample_sm::state_t state() const { return current_state_m; }
+    bool idle() const { return current_state_m == sample_sm::state_t::idle; }
+    void emit(const boost::optional<bool>& symbol) { sym_sm.get().process(symbol); }
     const size_t sample_rate;
 private:
-    std::reference_wrapper<symbol_sm_t> sym_sm;
-    std::unique_ptr<sample_sm::state_base_t> current_state_m;
+    std::reference_wrapper<SymbolSink> sym_sm;
+    sample_sm::state_t current_state_m = sample_sm::state_t::idle;
+    sample_sm::idle_t idle_m;
+    sample_sm::bitlock_t bitlock_m;
 };
+
+namespace sample_sm
+{
+
+template <typename Ctx>
+void
+idle_t::process(Ctx&, const boost::optional<double>&)
+{
+}
+
+template <typename Ctx>
+void
+bitlock_t::process(Ctx& ctx, const boost::optional<double>& sample)
+{
+    // loop gains, on the timing error in symbols
+    const double PHASE_GAIN = 0.3;
+    const double PERIOD_GAIN = 0.01;
+    const double MAX_PERIOD_DEVIATION = 0.02;
+
+    // On no signal, return to idle
+    if (sample == boost::none)
+    {
+        ctx.emit(boost::none);
+        ctx.state(idle_t());
+        return;
+    }
+
+    next_strobe -= 1.0;
+    while (next_strobe <= 0.0)
+    {
+        // the strobe is between the last sample and this one
+        double y = *sample + next_strobe * (*sample - last_sample);
+        if (mid_strobe)
+        {
+            mid_symbol = y;
+            next_strobe += samples_per_symbol / 2.0;
+        }
+        else
+        {
+            amplitude = amplitude == 0.0 ? std::abs(y)
+                                         : 0.9 * amplitude + 0.1 * std::abs(y);
+            // Gardner: the mid strobe is off zero on a transition when the
+            // strobes are not centred, > 0 when they come too early
+            double error = 0.0;
+            if (amplitude > 0.0)
+            {
+                error = mid_symbol * (last_symbol - y) / (8.0 * amplitude * amplitude);
+                error = std::max(-0.5, std::min(0.5, error));
+            }
+            samples_per_symbol = std::max(
+                (1.0 - MAX_PERIOD_DEVIATION) * nominal_samples_per_symbol,
+                std::min((1.0 + MAX_PERIOD_DEVIATION) * nominal_samples_per_symbol,
+                         samples_per_symbol + PERIOD_GAIN * error * samples_per_symbol));
+            next_strobe += samples_per_symbol / 2.0 + PHASE_GAIN * error * samples_per_symbol;
+            last_symbol = y;
+            ctx.emit(y > 0.0);
+        }
+        mid_strobe = !mid_strobe;
+    }
+    last_sample = *sample;
+}
+
+} // namespace
 } // namespace
 
-struct demod_nrz
+///
+/// Start of frame detector
+///
+/// Correlates the discriminator output with the end of the preamble (0x55)
+/// followed by the SOF (0xF0). The correlation peak marks the end of the
+/// SOF, hence the payload symbol timing, and the mean over the pattern is the
+/// carrier frequency offset. Sixteen symbols of preamble and SOF are enough,
+/// and noise is rejected here without driving the state machines.
+///
+struct start_of_frame_detector
+{
+    ///
+    /// @param samples_per_symbol Samples per symbol of the discriminator output
+    /// @param threshold Correlation (at most 1) that detects a frame
+    ///
+    start_of_frame_detector(double samples_per_symbol, double threshold = 0.8)
+      : stride_m(std::max(1, int(samples_per_symbol / 4.0)))
+      , correlator_m({ 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 1, 1, 0, 0, 0, 0 },
+                     samples_per_symbol / stride_m)
+      , threshold_m(threshold)
+    {
+    }
+
+    ///
+    /// Add a sample ('1' > 0).
+    ///
+    /// Heavily oversampled signals are correlated at about four samples per
+    /// symbol, the symbol timing recovery takes care of the remaining error.
+    ///
+    /// @returns true when a correlation peak was found, age samples ago; the
+    ///          peak is the highest correlation over a quarter of a symbol
+    ///
+    bool operator()(double x)
+    {
+        ++age;
+        if (++phase_m != stride_m)
+        {
+            return false;
+        }
+        phase_m = 0;
+        if (correlator_m(x, pending_m ? correlation : threshold_m))
+        {
+            if (!pending_m) wait_m = 1;
+            pending_m = true;
+            correlation = correlator_m.correlation();
+            mean = correlator_m.mean();
+            deviation = correlator_m.deviation();
+            age = 0;
+        }
+        if (pending_m)
+        {
+            if (wait_m == 0)
+            {
+                pending_m = false;
+                return true;
+            }
+            --wait_m;
+        }
+        return false;
+    }
+
+    // last peak
+    size_t age = 0;          // samples since the last sample of the SOF
+    double correlation = 0.0;
+    double mean = 0.0;       // over the preamble and SOF
+    double deviation = 0.0;  // over the preamble and SOF
+
+  private:
+    const int stride_m;
+    symbol_correlator correlator_m;
+    double threshold_m;
+    int phase_m = 0;
+    size_t wait_m = 0;
+    bool pending_m = false;
+};
+
+///
+/// NRZ FSK demodulator
+///
+/// The Discriminator (atan_fm_demodulator, fast_atan_fm_demodulator or
+/// quadricorrelator_fm_demodulator) turns the channel filtered IQ samples
+/// into instantaneous frequency.
+///
+/// Each frame is handed to the Sink as a frame_view_t. The Sink is stored by
+/// value and called directly; function_sink adapts std::function callbacks.
+///
+template <typename Discriminator, typename Sink = function_sink>
+struct basic_demod_nrz
 {
-    demod_nrz(size_t sample_rate,
-              std::function<void(uint8_t* begin, uint8_t* end)> packet_callback)
-        : lp1(butter_lp<6>(sample_rate, 150000))
+    typedef Sink sink_type;
+
+    ///
+    /// @param sample_rate Input sample rate
+    /// @param sink Called with each decoded frame (anything Sink can be
+    ///        constructed from, e.g. a callback for function_sink)
+    /// @param decimation Decimation applied before the FSK discriminator
+    ///        (1 to run the whole chain at the input rate)
+    ///
+    template <typename SinkArg>
+    basic_demod_nrz(size_t sample_rate, SinkArg&& sink, size_t decimation = 1)
+        : sink(std::forward<SinkArg>(sink))
+        , decimation(decimation)
+        , decimator(decimation, fir_lp(12 * decimation + 1, sample_rate,
+                                       std::min(150000.0, 0.4 * sample_rate / decimation)))
+        , lp1(butter_lp<6>(sample_rate, 150000))
         , lp2(butter_lp<6>(sample_rate, 150000))
-        , freq_filter(butter_lp<3>(sample_rate, 50000))
-        , lock_filter(butter_lp<3>(sample_rate, 750))
-        , symbols_sm(packet_callback)
-        , samples_sm(sample_rate, symbols_sm)
+        , freq_filter(butter_lp<3>(sample_rate / decimation,
+                                   std::min(50000.0, 0.4 * sample_rate / decimation)))
+        , lock_filter(butter_lp<3>(sample_rate / decimation, 750))
+        , symbols_sm(frame_emitter{ this })
+        , samples_sm(sample_rate / decimation, symbols_sm)
+        , samples_per_symbol(double(sample_rate) / decimation / 40000.0)
+        , sof_detector(samples_per_symbol)
+        , sof_delay(std::lround((decimation == 1 ? lp1.group_delay() : decimator.group_delay()) +
+                                decimation * freq_filter.group_delay()))
+        , lock_threshold(0.01 * decimation)
 
     {
     }
 
+    // the state machines point back to the demodulator
+    basic_demod_nrz(const basic_demod_nrz&) = delete;
+    basic_demod_nrz& operator=(const basic_demod_nrz&) = delete;
+    basic_demod_nrz(basic_demod_nrz&&) = delete;
+    basic_demod_nrz& operator=(basic_demod_nrz&&) = delete;
+
     void operator()(std::complex<double> iq)
     {
-        iq = std::complex<double>(lp1(iq.real()), lp2(iq.imag()));
+        ++sample_counter;
+        if (decimation == 1)
+        {
+            iq = std::complex<double>(lp1(iq.real()), lp2(iq.imag()));
+        }
+        else if (!decimator(iq, iq))
+        {
+            return;
+        }
         double f = fsk_demod(iq);
-        double s = freq_filter(f);
-        double lock_freq = lock_filter(f);
-        boost::optional<bool> sample;
+        slice(freq_filter(f), lock_filter(f), std::norm(iq));
+    }
 
-        // check for signal, adjust central freq, and get sample
-        bool signal = std::abs(lock_freq) > 0.01;
-        if(signal)
+    ///
+    /// Demodulate a block of samples.
+    ///
+    /// Each stage (channel filter, discriminator, post filters) runs over
+    /// the whole block before the slicer and the state machines consume it.
+    ///
+    /// With the squelch enabled, blocks without energy are skipped while the
+    /// state machines are idle; the last skipped samples are kept and
+    /// demodulated first when the squelch opens, so the preamble is not cut.
+    ///
+    template <typename T>
+    void process(const std::complex<T>* begin, const std::complex<T>* end)
+    {
+        if (!squelch)
         {
-            if (samples_sm.idle()) omega_c = lock_freq;
-            sample = (s - omega_c) < 0.0;
-            if (samples_sm.preamble()) omega_c = 0.95 * omega_c + lock_freq * 0.05;
+            demodulate(begin, end);
+            return;
+        }
+        while (begin != end)
+        {
+            const size_t n = std::min(size_t(end - begin), size_t(squelch_block));
+            if ((*squelch)(begin, n))
+            {
+                squelch_hangover = 4;
+            }
+            if (squelch_hangover == 0 && samples_sm.idle())
+            {
+                keep_preroll(begin, n);
+            }
+            else
+            {
+                if (squelch_hangover) --squelch_hangover;
+                replay_preroll();
+                demodulate(begin, begin + n);
+            }
+            begin += n;
         }
-        // process the sample with the state machine
-        samples_sm.process(sample);
     }
 
-    atan_fm_demodulator fsk_demod;
+    Sink sink;
+    size_t channel = 0; // reported with each frame
+    const size_t decimation;
+    fir_decimator<std::complex<double>> decimator;
+    Discriminator fsk_demod;
     iir_filter<6> lp1, lp2;
     iir_filter<3> freq_filter;
     iir_filter<3> lock_filter;
-    state_machine::symbol_sm_t symbols_sm;
-    state_machine::sample_sm_t samples_sm;
+private:
+    /// Adds the demodulator measurements to the frames of the state machine
+    struct frame_emitter
+    {
+        basic_demod_nrz* demod;
+        void operator()(uint8_t* begin, uint8_t* end) const { demod->emit(begin, end); }
+        bool accept(const uint8_t* header) const { return demod->accept(header); }
+    };
+
+public:
+    state_machine::symbol_sm_t<frame_emitter> symbols_sm;
+    state_machine::sample_sm_t<state_machine::symbol_sm_t<frame_emitter>> samples_sm;
     double omega_c = 0.0;
+    uint64_t sample_counter = 0; // input samples processed so far
+
+    boost::optional<energy_squelch> squelch; // disabled by default
+    boost::optional<frame_filter> filter;    // disabled by default
+    size_t rejected_frames = 0;              // dropped by the filter
+
+private:
+    template <typename T>
+    void demodulate(const std::complex<T>* begin, const std::complex<T>* end)
+    {
+        while (begin != end)
+        {
+            const size_t n = std::min(size_t(end - begin), size_t(block_size));
+            const uint64_t block_start = sample_counter;
+            uint64_t first = sample_counter + 1; // counter at the first output
+            size_t m = n;
+            if (decimation == 1)
+            {
+                for (size_t ii(0); ii != n; ++ii)
+                {
+                    i_m[ii] = begin[ii].real();
+                    q_m[ii] = begin[ii].imag();
+                }
+                lp1.process(i_m.data(), i_m.data(), n);
+                lp2.process(q_m.data(), q_m.data(), n);
+                for (size_t ii(0); ii != n; ++ii)
+                {
+                    p_m[ii] = i_m[ii] * i_m[ii] + q_m[ii] * q_m[ii];
+                }
+            }
+            else
+            {
+                std::copy(begin, begin + n, x_m.begin());
+                first = sample_counter + decimator.remaining();
+                m = decimator.process(x_m.data(), n, x_m.data());
+                for (size_t ii(0); ii != m; ++ii)
+                {
+                    i_m[ii] = x_m[ii].real();
+                    q_m[ii] = x_m[ii].imag();
+                    p_m[ii] = std::norm(x_m[ii]);
+                }
+            }
+            fsk_demod(i_m.data(), q_m.data(), f_m.data(), m);
+            freq_filter.process(f_m.data(), i_m.data(), m);
+            lock_filter.process(f_m.data(), q_m.data(), m);
+            for (size_t ii(0); ii != m; ++ii)
+            {
+                sample_counter = first + ii * decimation;
+                slice(i_m[ii], q_m[ii], p_m[ii]);
+            }
+            sample_counter = block_start + n;
+            begin += n;
+        }
+    }
+
+    /// Skip samples while keeping the most recent ones as pre-roll
+    template <typename T>
+    void keep_preroll(const std::complex<T>* begin, size_t n)
+    {
+        for (size_t ii(0); ii != n; ++ii)
+        {
+            preroll_m[preroll_pos] = begin[ii];
+            preroll_pos = preroll_pos + 1 == preroll_m.size() ? 0 : preroll_pos + 1;
+        }
+        preroll_size = std::min(preroll_size + n, preroll_m.size());
+        sample_counter += n;
+    }
+
+    /// Demodulate the kept pre-roll, oldest sample first
+    void replay_preroll()
+    {
+        if (preroll_size == 0) return;
+        sample_counter -= preroll_size;
+        size_t start = (preroll_pos + preroll_m.size() - preroll_size) % preroll_m.size();
+        size_t first = std::min(preroll_size, preroll_m.size() - start);
+        demodulate(&preroll_m[start], &preroll_m[start] + first);
+        demodulate(&preroll_m[0], &preroll_m[0] + (preroll_size - first));
+        preroll_size = 0;
+    }
+
+    /// check for signal, adjust central freq, and get sample
+    void slice(double s, double lock_freq, double power)
+    {
+        if (samples_sm.idle())
+        {
+            power_sum = 0.0;
+            power_samples = 0;
+        }
+        else
+        {
+            power_sum += power;
+            ++power_samples;
+        }
+
+        if (sof_detector(-s) &&
+            symbols_sm.state() != state_machine::symbol_sm::state_t::payload)
+        {
+            // the first payload symbol is centred half a symbol after the
+            // end of the SOF, the strobe is counted from the last sample
+            omega_c = -sof_detector.mean;
+            frame_sof = sample_counter - std::min<uint64_t>(sample_counter,
+                                                            sof_detector.age * decimation + sof_delay);
+            double next_strobe = samples_per_symbol / 2.0 + 1.5 - sof_detector.age;
+            samples_sm.state(state_machine::sample_sm::bitlock_t(
+                samples_per_symbol, next_strobe, omega_c - last_s, -sof_detector.deviation));
+            symbols_sm.state(state_machine::symbol_sm::payload_t());
+        }
+        last_s = s;
+
+        boost::optional<double> sample;
+        bool signal = std::abs(lock_freq) > lock_threshold;
+        if(signal)
+        {
+            sample = omega_c - s; // > 0 for a '1'
+        }
+        // process the sample with the state machine
+        samples_sm.process(sample);
+    }
+
+    bool accept(const uint8_t* header)
+    {
+        if (!filter || (*filter)(header)) return true;
+        ++rejected_frames;
+        return false;
+    }
+
+    void emit(uint8_t* begin, uint8_t* end)
+    {
+        frame_view_t frame{ begin, end, sample_counter, frame_sof, channel,
+                            10.0 * std::log10(power_sum / std::max<size_t>(power_samples, 1)) };
+        sink(frame);
+    }
+
+    const double samples_per_symbol; // at 40kbaud, after decimation
+    start_of_frame_detector sof_detector;
+    // input samples from the end of the SOF on air to its detection, the
+    // group delay of the channel and frequency filters
+    const uint64_t sof_delay;
+    uint64_t frame_sof = 0; // input sample at the end of the SOF of the current frame
+    double last_s = 0.0;
+
+    // same frequency threshold whatever the decimation (rad/sample)
+    const double lock_threshold;
+
+    static constexpr size_t block_size = 4096;
+    std::vector<double> i_m = std::vector<double>(block_size);
+    std::vector<double> q_m = std::vector<double>(block_size);
+    std::vector<double> f_m = std::vector<double>(block_size);
+    std::vector<double> p_m = std::vector<double>(block_size);
+    std::vector<std::complex<double>> x_m = std::vector<std::complex<double>>(block_size);
+
+    static constexpr size_t squelch_block = 1024;
+    size_t squelch_hangover = 0; // blocks still demodulated after the squelch closed
+    std::vector<std::complex<double>> preroll_m = std::vector<std::complex<double>>(2 * squelch_block);
+    size_t preroll_pos = 0;
+    size_t preroll_size = 0;
+
+    // channel filtered power since the signal was detected
+    double power_sum = 0.0;
+    size_t power_samples = 0;
 };
 
+typedef basic_demod_nrz<atan_fm_demodulator> demod_nrz;
+
+// instantiated once in wavingz.cpp
+extern template struct basic_demod_nrz<atan_fm_demodulator>;
+
 } // namespace
 } // namespace